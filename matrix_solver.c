@@ -6,10 +6,163 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <float.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #define MAX_MATRIX_SIZE 1000
 #define MIN_VALUE -100
 #define MAX_VALUE 100
+#define VALUE_RANGE (MAX_VALUE - MIN_VALUE + 1)
+// Bound on |x| for generated values; an even MAX_VALUE is bumped to MAX_VALUE + 1
+#define GENERATED_MAX_MAGNITUDE ((MAX_VALUE + 1 > -MIN_VALUE) ? MAX_VALUE + 1 : -MIN_VALUE)
+#define SLIDING_TILE_ROWS 64
+#define PREFIX_COLUMN_BLOCK 512
+#define DEFAULT_L2_BYTES (256 * 1024)
+#define MATRIX_ALIGNMENT 64
+#define STREAM_BAND_ROWS 256
+#define RESIDENT_TILE 32
+#define DEFAULT_MAX_WINDOW 16
+#define DYNAMIC_TILE 256
+#define DYNAMIC_HALO_RATIO 4
+#define GPU_ROW_RESULTS 64
+#define PRUNE_TILE 16
+#define PRUNE_SYNC_TILES 64
+#define BOUND_SCALE 1024
+#define FIXED_POINT_BITS 20
+#define DEFAULT_SEED 42
+#define PLACEMENT_LINE 1024
+#define DEFAULT_VERIFY_CASES 24
+#define DEFAULT_CHECKPOINT_SECONDS 60
+#define CHECKPOINT_MAGIC 0x43325748u  // "HW2C"
+#define CHECKPOINT_VERSION 2
+#define FNV1A64_OFFSET 0xCBF29CE484222325ull
+#define VERIFY_MAX_SIZE 48
+#define MATRIX_FILE_MAGIC 0x4D325748u  // "HW2M"
+#define MATRIX_FILE_VERSION 1
+#define MATRIX_ELEM_INT32 1
+#define MATRIX_ELEM_INT8 2
+
+// Element type of stored matrices. Building with -DHW2_INT8 stores one
+// byte per element, enough for the MIN_VALUE..MAX_VALUE domain, which cuts
+// memory, file size and transfer volume by four.
+#ifdef HW2_INT8
+typedef int8_t MatrixElement;
+#define MPI_MATRIX_ELEMENT MPI_INT8_T
+#define MATRIX_ELEM_TYPE MATRIX_ELEM_INT8
+#define ELEMENT_MIN INT8_MIN
+#define ELEMENT_MAX INT8_MAX
+#else
+typedef int MatrixElement;
+#define MPI_MATRIX_ELEMENT MPI_INT
+#define MATRIX_ELEM_TYPE MATRIX_ELEM_INT32
+#define ELEMENT_MIN INT_MIN
+#define ELEMENT_MAX INT_MAX
+#endif
+
+// Structure to hold a matrix in one contiguous allocation. Every row starts
+// on a MATRIX_ALIGNMENT byte boundary; stride is the distance in elements
+// between the starts of consecutive rows. A Matrix may also be a view into
+// a larger matrix, sharing its data and stride.
+typedef struct {
+    MatrixElement *data;
+    int rows;
+    int cols;
+    int stride;
+} Matrix;
+
+// Structure to hold a matrix pre-transformed into per-element contributions:
+// log|x| for odd x and 0 otherwise, plus a 0/1 odd mask. Both planes share
+// the same padded row stride.
+typedef struct {
+    double *log_values;
+    unsigned char *odd_mask;
+    int rows;
+    int cols;
+    int stride;
+} ContributionPlane;
+
+// Structure to produce matrix rows in order, a band at a time, so matrices
+// that do not fit in memory can be searched
+typedef struct RowSource {
+    int rows;
+    int cols;
+    int next_row;
+    // Fill count rows of dest starting at dest_row with the next rows
+    void (*read_rows)(struct RowSource *source, Matrix *dest, int dest_row, int count);
+    void *context;
+} RowSource;
+
+// Header of the binary matrix format: the header is followed, at
+// data_offset bytes, by rows of stride elements of which the first cols
+// are the matrix. Rows are padded so each starts on a 64-byte boundary.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t elem_type;
+    uint32_t elem_size;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t stride;
+    uint64_t data_offset;
+    uint8_t reserved[16];
+} MatrixFileHeader;
+
+// Structure to hold a read-only mapping of part of a matrix file
+typedef struct {
+    void *base;
+    size_t length;
+} FileMapping;
+
+// Structure to describe the window start positions owned by one MPI rank.
+// The rank holds (window_rows + K - 1) x (window_cols + K - 1) matrix
+// elements: its own windows plus a K-1 halo on the bottom and right.
+typedef struct {
+    int first_row;
+    int first_col;
+    int window_rows;
+    int window_cols;
+} RankBlock;
+
+// Available search engines
+typedef enum {
+    ENGINE_NAIVE,    // Rescan every KxK window (reference)
+    ENGINE_PREFIX,   // 2D prefix sums, O(1) per window
+    ENGINE_SLIDING,  // Incremental column sums per row strip, O(M) scratch
+    ENGINE_SIMD,     // Sliding column sums with vector kernels and CPU dispatch
+    ENGINE_GPU,      // Prefix sums and per-row argmax on an OpenMP offload device
+    ENGINE_BOUND     // Naive scoring, skipping tiles whose upper bound cannot win
+} SearchEngine;
+
+// Structure to hold a tile size in window positions
+typedef struct {
+    int rows;
+    int cols;
+} TileSize;
+
+// Tile size for the naive engine's tiled scheduler; 0 x 0 sizes tiles
+// from the L2 cache
+static TileSize tile_setting = {0, 0};
+
+// Thread support MPI_Init_thread provided. With MPI_THREAD_SERIALIZED the
+// threads of a dynamic pass claim their own tiles; otherwise only the
+// initial thread makes MPI calls.
+static int mpi_thread_level = MPI_THREAD_SINGLE;
+
+// Structure to hold the shape of a searched window
+typedef struct {
+    int rows, cols;
+} WindowShape;
 
 // Structure to hold result information
 typedef struct {
@@ -18,45 +171,297 @@ typedef struct {
     double max_log_product;
 } SubmatrixResult;
 
-// Function to generate random matrix
-void generate_random_matrix(int **matrix, int N, int M) {
-    srand(42); // Fixed seed for reproducibility
-    //srand(time(NULL)); // Uncomment for different random values each run
-    for (int i = 0; i < N; i++) {
-        for (int j = 0; j < M; j++) {
-            matrix[i][j] = (rand() % (MAX_VALUE - MIN_VALUE + 1)) + MIN_VALUE;
-            // Ensure we have some odd numbers
-            if (matrix[i][j] % 2 == 0 && rand() % 3 == 0) {
-                matrix[i][j] += 1;
-            }
-        }
+// Phases of a run timed for the report. Time is charged to exactly one
+// phase at a time: entering a phase pauses the enclosing one.
+typedef enum {
+    PHASE_OTHER,            // Setup, I/O and anything not listed below
+    PHASE_LOAD,             // Matrix generation or file mapping
+    PHASE_PREPROCESS,       // Prefix tables and contribution planes
+    PHASE_TRANSFER,         // Packing and scattering blocks
+    PHASE_KERNEL,           // Window scoring
+    PHASE_LOCAL_REDUCE,     // Merging thread results inside a rank
+    PHASE_GLOBAL_REDUCE,    // Combining results across ranks
+    PHASE_CHECKPOINT,       // Writing and restoring checkpoints
+    PHASE_COUNT
+} Phase;
+
+static const char *phase_names[PHASE_COUNT] = {
+    "other", "load", "preprocess", "transfer", "kernel", "local_reduce", "global_reduce",
+    "checkpoint"
+};
+static double phase_seconds[PHASE_COUNT];
+static Phase current_phase = PHASE_OTHER;
+static double phase_mark;
+
+// Function to switch the running phase, returns the phase to restore.
+// Only the initial thread keeps phases; calls inside parallel regions
+// are ignored.
+static inline Phase phase_switch(Phase next) {
+    if (omp_in_parallel()) return next;
+    double now = omp_get_wtime();
+    Phase previous = current_phase;
+    phase_seconds[current_phase] += now - phase_mark;
+    phase_mark = now;
+    current_phase = next;
+    return previous;
+}
+
+// Structure to hold the load counters of one OpenMP thread, padded to a
+// cache line so threads never share one
+typedef struct {
+    double windows;         // Windows scored
+    double busy;            // Seconds spent scoring
+    double merge;           // Seconds spent merging results, including lock waits
+    double idle;            // Seconds spent waiting for the other threads
+    char padding[32];
+} ThreadCounters;
+
+#define MAX_REPORT_THREADS 256
+static ThreadCounters thread_counters[MAX_REPORT_THREADS];
+static int report_threads = 0;
+
+
+// Function to get a pointer to row i of a matrix
+static inline MatrixElement *matrix_row(const Matrix *matrix, int i) {
+    return matrix->data + (size_t)i * matrix->stride;
+}
+
+// Seed of the matrix generator; every cell is a pure function of the
+// seed and its global position
+static uint64_t generator_seed = DEFAULT_SEED;
+
+// Function to mix a 64-bit value with the SplitMix64 finalizer
+static inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Function to generate the value of cell (i, j) of the random matrix.
+// Values are uniform in [MIN_VALUE, MAX_VALUE], with a third of the even
+// values bumped to odd ones so every matrix has plenty of odd numbers, so
+// an even MAX_VALUE can come out as MAX_VALUE + 1.
+static inline int generate_value(uint64_t seed, int i, int j) {
+    uint64_t z = splitmix64(seed ^ splitmix64(((uint64_t)(uint32_t)i << 32) | (uint32_t)j));
+    int value = MIN_VALUE + (int)(((z & 0xFFFFFFFFull) * VALUE_RANGE) >> 32);
+    if (value % 2 == 0 && (((z >> 32) * 3) >> 32) == 0)
+        value += 1;
+    return value;
+}
+
+// Function to fill count rows of dest, starting at row dest_row, with the
+// random matrix's rows from first_row and columns from first_col. Cells
+// are independent, so any block can be generated anywhere, in any order,
+// by any number of threads.
+void generate_block_rows(Matrix *dest, int dest_row, int first_row, int first_col, int count) {
+    Phase previous = phase_switch(PHASE_LOAD);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        MatrixElement *row = matrix_row(dest, dest_row + i);
+        for (int j = 0; j < dest->cols; j++)
+            row[j] = generate_value(generator_seed, first_row + i, first_col + j);
     }
+    phase_switch(previous);
+}
+
+// Function to generate random matrix
+void generate_random_matrix(Matrix *matrix) {
+    generate_block_rows(matrix, 0, 0, 0, matrix->rows);
+}
+
+// RowSource callback producing rows from the random generator
+void generator_read_rows(RowSource *source, Matrix *dest, int dest_row, int count) {
+    generate_block_rows(dest, dest_row, source->next_row, 0, count);
+    source->next_row += count;
+}
+
+// Function to open a row source over the N x M random matrix
+RowSource open_generator_source(int N, int M) {
+    RowSource source = {N, M, 0, generator_read_rows, NULL};
+    return source;
+}
+
+// RowSource callback copying rows from the in-memory matrix in context
+void matrix_read_rows(RowSource *source, Matrix *dest, int dest_row, int count) {
+    const Matrix *matrix = (const Matrix *)source->context;
+    for (int i = 0; i < count; i++)
+        memcpy(matrix_row(dest, dest_row + i), matrix_row(matrix, source->next_row + i),
+               matrix->cols * sizeof(MatrixElement));
+    source->next_row += count;
+}
+
+// Function to open a row source over an in-memory matrix
+RowSource open_matrix_source(const Matrix *matrix) {
+    RowSource source = {matrix->rows, matrix->cols, 0, matrix_read_rows, (void *)matrix};
+    return source;
 }
 
-// Function to allocate 2D matrix
-int** allocate_matrix(int rows, int cols) {
-    int **matrix = (int **)malloc(rows * sizeof(int *));
-    if (matrix == NULL) {
+// Function to allocate a contiguous matrix with aligned, padded rows
+Matrix allocate_matrix(int rows, int cols) {
+    Matrix matrix;
+    int per_line = MATRIX_ALIGNMENT / sizeof(MatrixElement);
+    size_t bytes;
+
+    matrix.rows = rows;
+    matrix.cols = cols;
+    matrix.stride = (cols + per_line - 1) / per_line * per_line;
+    bytes = (size_t)rows * matrix.stride * sizeof(MatrixElement);
+    if (bytes == 0) bytes = MATRIX_ALIGNMENT;
+
+    matrix.data = (MatrixElement *)aligned_alloc(MATRIX_ALIGNMENT, bytes);
+    if (matrix.data == NULL) {
         fprintf(stderr, "Memory allocation failed\n");
         exit(1);
     }
-    
-    for (int i = 0; i < rows; i++) {
-        matrix[i] = (int *)malloc(cols * sizeof(int));
-        if (matrix[i] == NULL) {
-            fprintf(stderr, "Memory allocation failed\n");
-            exit(1);
-        }
+
+    // First touch: pages land on the NUMA node of the thread that first
+    // writes them, so rows are faulted in by the same static row split the
+    // generator, the prefix table build and the strip engines use
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; i++)
+        memset(matrix_row(&matrix, i), 0, (size_t)matrix.stride * sizeof(MatrixElement));
+    return matrix;
+}
+
+// Function to get a view of the rows x cols block starting at (row, col)
+Matrix matrix_view(const Matrix *matrix, int row, int col, int rows, int cols) {
+    Matrix view;
+    view.data = matrix_row(matrix, row) + col;
+    view.rows = rows;
+    view.cols = cols;
+    view.stride = matrix->stride;
+    return view;
+}
+
+// Function to free a matrix allocated by allocate_matrix
+void free_matrix(Matrix *matrix) {
+    free(matrix->data);
+    matrix->data = NULL;
+}
+
+// Function to write the matrix produced by source to a binary matrix file,
+// band by band, returns 0 on failure
+int write_matrix_file(const char *path, RowSource *source) {
+    MatrixFileHeader header;
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Error: Cannot create matrix file '%s'\n", path);
+        return 0;
+    }
+
+    Matrix band = allocate_matrix(STREAM_BAND_ROWS, source->cols);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = MATRIX_FILE_MAGIC;
+    header.version = MATRIX_FILE_VERSION;
+    header.elem_type = MATRIX_ELEM_TYPE;
+    header.elem_size = sizeof(MatrixElement);
+    header.rows = source->rows;
+    header.cols = source->cols;
+    header.stride = band.stride;
+    header.data_offset = sizeof(MatrixFileHeader);
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    while (ok && source->next_row < source->rows) {
+        int count = source->rows - source->next_row;
+        if (count > STREAM_BAND_ROWS) count = STREAM_BAND_ROWS;
+        source->read_rows(source, &band, 0, count);
+        size_t elements = (size_t)count * band.stride;
+        ok = fwrite(band.data, sizeof(MatrixElement), elements, file) == elements;
+    }
+
+    free_matrix(&band);
+    if (fclose(file) != 0) ok = 0;
+    if (!ok) printf("Error: Failed writing matrix file '%s'\n", path);
+    return ok;
+}
+
+// Function to read and check the header of a binary matrix file,
+// returns 0 on failure
+int read_matrix_header(const char *path, MatrixFileHeader *header) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("Error: Cannot open matrix file '%s'\n", path);
+        return 0;
+    }
+    int ok = fread(header, sizeof(*header), 1, file) == 1;
+    fclose(file);
+
+    if (!ok || header->magic != MATRIX_FILE_MAGIC || header->version != MATRIX_FILE_VERSION) {
+        printf("Error: '%s' is not a matrix file\n", path);
+        return 0;
+    }
+    if (header->elem_type != MATRIX_ELEM_TYPE || header->elem_size != sizeof(MatrixElement)) {
+        printf("Error: '%s' stores %u-byte elements but this build stores %d-byte elements\n",
+               path, header->elem_size, (int)sizeof(MatrixElement));
+        return 0;
+    }
+    if (header->rows > INT_MAX || header->cols > INT_MAX ||
+        header->stride < header->cols || header->stride > INT_MAX) {
+        printf("Error: Invalid dimensions in '%s'\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+// Function to map the rows x cols block at (first_row, first_col) of a
+// matrix file read-only. The returned Matrix points straight into the
+// page cache; only the rows of the block are mapped.
+Matrix map_matrix_file(const char *path, const MatrixFileHeader *header,
+                       int first_row, int first_col, int rows, int cols,
+                       FileMapping *mapping) {
+    Matrix matrix = {NULL, rows, cols, (int)header->stride};
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t row_bytes = (size_t)header->stride * header->elem_size;
+    size_t start = header->data_offset + (size_t)first_row * row_bytes;
+    size_t end = start + (size_t)rows * row_bytes;
+    size_t map_start = start / page * page;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open matrix file '%s'\n", path);
+        exit(1);
+    }
+    mapping->length = end - map_start;
+    mapping->base = mmap(NULL, mapping->length, PROT_READ, MAP_PRIVATE, fd, (off_t)map_start);
+    close(fd);
+    if (mapping->base == MAP_FAILED) {
+        fprintf(stderr, "Memory mapping of '%s' failed\n", path);
+        exit(1);
     }
+
+    matrix.data = (MatrixElement *)((char *)mapping->base + (start - map_start)) + first_col;
     return matrix;
 }
 
-// Function to free 2D matrix
-void free_matrix(int **matrix, int rows) {
+// Function to release a mapping made by map_matrix_file
+void unmap_matrix_file(FileMapping *mapping) {
+    if (mapping->base != NULL)
+        munmap(mapping->base, mapping->length);
+    mapping->base = NULL;
+}
+
+// Function to get the largest |x| in a matrix file, read through a mapping
+// of the whole file
+long long matrix_file_max_magnitude(const char *path, const MatrixFileHeader *header) {
+    Phase previous = phase_switch(PHASE_LOAD);
+    int rows = (int)header->rows, cols = (int)header->cols;
+    FileMapping mapping;
+    Matrix matrix = map_matrix_file(path, header, 0, 0, rows, cols, &mapping);
+    long long largest = 0;
+
+    #pragma omp parallel for reduction(max : largest) schedule(static)
     for (int i = 0; i < rows; i++) {
-        free(matrix[i]);
+        const MatrixElement *row = matrix_row(&matrix, i);
+        for (int j = 0; j < cols; j++) {
+            long long magnitude = llabs((long long)row[j]);
+            if (magnitude > largest) largest = magnitude;
+        }
     }
-    free(matrix);
+    unmap_matrix_file(&mapping);
+    phase_switch(previous);
+    return largest;
 }
 
 // Function to check if number is odd
@@ -64,18 +469,62 @@ int is_odd(int num) {
     return abs(num) % 2 == 1;
 }
 
-// Function to calculate log sum of odd elements in submatrix
-double calculate_log_product_submatrix(int **matrix, int start_row, 
-                                     int start_col, int K) {
+// Lookup tables indexed by value - MIN_VALUE: the contribution of a value
+// to a window's log sum (log|x| for odd x, 0 for even x) and its odd flag
+static double log_table[VALUE_RANGE];
+static unsigned char odd_table[VALUE_RANGE];
+static int value_tables_ready = 0;
+
+// Scores are sums of fixed-point contributions when set (--reproducible)
+static int fixed_point_scores = 0;
+
+// Function to round a contribution to a multiple of 2^-FIXED_POINT_BITS
+// when fixed-point scores are on. Sums of such values are exact in a
+// double while below 2^(53 - FIXED_POINT_BITS), so every engine, thread
+// count and rank count adds up to the same bits in any order.
+static inline double score_contribution(double log_value) {
+    if (!fixed_point_scores) return log_value;
+    return ldexp(nearbyint(ldexp(log_value, FIXED_POINT_BITS)), -FIXED_POINT_BITS);
+}
+
+// Function to fill the value lookup tables (call before searching)
+void init_value_tables(void) {
+    if (value_tables_ready) return;
+    for (int v = MIN_VALUE; v <= MAX_VALUE; v++) {
+        log_table[v - MIN_VALUE] = is_odd(v) ? score_contribution(log(abs(v))) : 0.0;
+        odd_table[v - MIN_VALUE] = (unsigned char)is_odd(v);
+    }
+    value_tables_ready = 1;
+}
+
+// Function to get the log sum contribution of a value. Values outside
+// MIN_VALUE..MAX_VALUE (possible in loaded files) fall back to libm.
+static inline double value_log(int num) {
+    unsigned index = (unsigned)(num - MIN_VALUE);
+    if (index < VALUE_RANGE) return log_table[index];
+    return is_odd(num) ? score_contribution(log(abs(num))) : 0.0;
+}
+
+// Function to get 1 for odd values and 0 otherwise, through the table
+static inline int value_odd(int num) {
+    unsigned index = (unsigned)(num - MIN_VALUE);
+    if (index < VALUE_RANGE) return odd_table[index];
+    return is_odd(num);
+}
+
+// Function to calculate log sum of odd elements in a rows x cols window.
+// Even values contribute exactly 0, so the sum matches adding only the
+// odd elements.
+double calculate_log_product_window(const Matrix *matrix, int start_row, int start_col,
+                                    int rows, int cols) {
     double log_sum = 0.0;
     int odd_count = 0;
     
-    for (int i = start_row; i < start_row + K; i++) {
-        for (int j = start_col; j < start_col + K; j++) {
-            if (is_odd(matrix[i][j]) && matrix[i][j] != 0) {
-                log_sum += log(abs(matrix[i][j]));
-                odd_count++;
-            }
+    for (int i = start_row; i < start_row + rows; i++) {
+        const MatrixElement *row = matrix_row(matrix, i);
+        for (int j = start_col; j < start_col + cols; j++) {
+            log_sum += value_log(row[j]);
+            odd_count += value_odd(row[j]);
         }
     }
     
@@ -83,207 +532,4873 @@ double calculate_log_product_submatrix(int **matrix, int start_row,
     return (odd_count > 0) ? log_sum : -INFINITY;
 }
 
-// Function to check if submatrix is valid
-int is_valid_submatrix(int i, int j, int K, int N, int M) {
-    return (i + K <= N && j + K <= M);
+// Function to calculate log sum of odd elements in a K x K submatrix
+double calculate_log_product_submatrix(const Matrix *matrix, int start_row,
+                                       int start_col, int K) {
+    return calculate_log_product_window(matrix, start_row, start_col, K, K);
 }
 
-// Main function to find best submatrix using OpenMP
-SubmatrixResult find_best_submatrix_parallel(int **matrix, int N, int M, int K) {
-    SubmatrixResult best_result = {-1, -1, -INFINITY};
-    
-    // Parallel search using OpenMP
-    #pragma omp parallel
-    {
-        SubmatrixResult local_best = {-1, -1, -INFINITY};
-        
-        #pragma omp for collapse(2) schedule(dynamic)
-        for (int i = 0; i <= N - K; i++) {
-            for (int j = 0; j <= M - K; j++) {
-                if (is_valid_submatrix(i, j, K, N, M)) {
-                    double current_log_product = 
-                        calculate_log_product_submatrix(matrix, i, j, K);
-                    
-                    if (current_log_product > local_best.max_log_product) {
-                        local_best.row = i;
-                        local_best.col = j;
-                        local_best.max_log_product = current_log_product;
-                    }
-                }
-            }
-        }
-        
-        // Critical section to update global best
-        #pragma omp critical
-        {
-            if (local_best.max_log_product > best_result.max_log_product) {
-                best_result = local_best;
-            }
-        }
+// Function to transform a matrix into its contribution plane
+ContributionPlane build_contribution_plane(const Matrix *matrix) {
+    Phase previous = phase_switch(PHASE_PREPROCESS);
+    ContributionPlane plane;
+    int per_line = MATRIX_ALIGNMENT / sizeof(double);
+    size_t elements;
+
+    plane.rows = matrix->rows;
+    plane.cols = matrix->cols;
+    plane.stride = (matrix->cols + per_line - 1) / per_line * per_line;
+    elements = (size_t)plane.rows * plane.stride;
+    if (elements == 0) elements = per_line;
+
+    plane.log_values = (double *)aligned_alloc(MATRIX_ALIGNMENT, elements * sizeof(double));
+    plane.odd_mask = (unsigned char *)aligned_alloc(MATRIX_ALIGNMENT, elements);
+    if (plane.log_values == NULL || plane.odd_mask == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
     }
-    
-    return best_result;
-}
 
-// Function to print matrix (for debugging small matrices)
-void print_matrix(int **matrix, int N, int M, int max_print) {
-    int print_N = (N > max_print) ? max_print : N;
-    int print_M = (M > max_print) ? max_print : M;
-    
-    printf("Matrix (%dx%d):\n", N, M);
-    for (int i = 0; i < print_N; i++) {
-        for (int j = 0; j < print_M; j++) {
-            printf("%4d ", matrix[i][j]);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < plane.rows; i++) {
+        const MatrixElement *row = matrix_row(matrix, i);
+        double *log_row = plane.log_values + (size_t)i * plane.stride;
+        unsigned char *odd_row = plane.odd_mask + (size_t)i * plane.stride;
+        for (int j = 0; j < plane.cols; j++) {
+            log_row[j] = value_log(row[j]);
+            odd_row[j] = (unsigned char)value_odd(row[j]);
         }
-        if (M > max_print) printf(" ...");
-        printf("\n");
     }
-    if (N > max_print) printf("...\n");
-    printf("\n");
+    phase_switch(previous);
+    return plane;
 }
 
-// Function to print submatrix at given position
-void print_submatrix(int **matrix, int start_row, int start_col, int K) {
-    printf("Submatrix at position (%d, %d):\n", start_row, start_col);
+// Function to free a contribution plane
+void free_contribution_plane(ContributionPlane *plane) {
+    free(plane->log_values);
+    free(plane->odd_mask);
+    plane->log_values = NULL;
+    plane->odd_mask = NULL;
+}
+
+// Function to calculate log sum of odd elements in a window of a
+// contribution plane, with no libm calls or branches in the loop
+double calculate_log_product_plane(const ContributionPlane *plane, int start_row,
+                                   int start_col, int K) {
+    double log_sum = 0.0;
+    int odd_count = 0;
+
     for (int i = start_row; i < start_row + K; i++) {
+        const double *log_row = plane->log_values + (size_t)i * plane->stride;
+        const unsigned char *odd_row = plane->odd_mask + (size_t)i * plane->stride;
         for (int j = start_col; j < start_col + K; j++) {
-            printf("%4d ", matrix[i][j]);
-            if (is_odd(matrix[i][j])) printf("*");
-            else printf(" ");
+            log_sum += log_row[j];
+            odd_count += odd_row[j];
         }
-        printf("\n");
     }
-    printf("(* marks odd numbers)\n\n");
+
+    return (odd_count > 0) ? log_sum : -INFINITY;
 }
 
-// Function to validate input parameters
-int validate_parameters(int N, int M, int K) {
-    if (N <= 0 || M <= 0 || K <= 0) {
-        printf("Error: N, M, and K must be positive integers\n");
-        return 0;
+// Function to check if a rows x cols window at (i, j) fits in the matrix
+int is_valid_window(int i, int j, int rows, int cols, int N, int M) {
+    return (i + rows <= N && j + cols <= M);
+}
+
+// Function to check if submatrix is valid
+int is_valid_submatrix(int i, int j, int K, int N, int M) {
+    return is_valid_window(i, j, K, K, N, M);
+}
+
+// Function to decide if candidate result beats current best
+// (higher log sum wins, ties go to the smallest row, then column)
+#pragma omp declare target
+int result_is_better(SubmatrixResult candidate, SubmatrixResult best) {
+    if (candidate.row == -1) return 0;
+    if (best.row == -1) return 1;
+    if (candidate.max_log_product != best.max_log_product)
+        return candidate.max_log_product > best.max_log_product;
+    if (candidate.row != best.row)
+        return candidate.row < best.row;
+    return candidate.col < best.col;
+}
+#pragma omp end declare target
+
+// Structure to hold the best windows seen so far, up to capacity, as a
+// binary min-heap: items[0] is the weakest window kept
+typedef struct {
+    SubmatrixResult *items;
+    int count;
+    int capacity;
+} ResultHeap;
+
+// Function to create an empty result heap
+ResultHeap create_result_heap(int capacity) {
+    ResultHeap heap;
+    heap.items = (SubmatrixResult *)malloc(capacity * sizeof(SubmatrixResult));
+    if (heap.items == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
     }
-    
-    if (K > N || K > M) {
-        printf("Error: K cannot be larger than N or M\n");
-        return 0;
+    heap.count = 0;
+    heap.capacity = capacity;
+    return heap;
+}
+
+// Function to free a result heap
+void free_result_heap(ResultHeap *heap) {
+    free(heap->items);
+    heap->items = NULL;
+    heap->count = 0;
+}
+
+// Function to restore the heap order below position index
+static void result_heap_sift_down(ResultHeap *heap, int index) {
+    for (;;) {
+        int weakest = index;
+        int left = 2 * index + 1, right = left + 1;
+        if (left < heap->count && result_is_better(heap->items[weakest], heap->items[left]))
+            weakest = left;
+        if (right < heap->count && result_is_better(heap->items[weakest], heap->items[right]))
+            weakest = right;
+        if (weakest == index) return;
+
+        SubmatrixResult tmp = heap->items[index];
+        heap->items[index] = heap->items[weakest];
+        heap->items[weakest] = tmp;
+        index = weakest;
     }
-    
-    if (N > MAX_MATRIX_SIZE || M > MAX_MATRIX_SIZE) {
-        printf("Error: Matrix size too large (max %d)\n", MAX_MATRIX_SIZE);
-        return 0;
+}
+
+// Function to add a window, dropping the weakest one when the heap is full
+void result_heap_push(ResultHeap *heap, SubmatrixResult candidate) {
+    if (candidate.row == -1) return;
+    if (heap->count == heap->capacity) {
+        if (!result_is_better(candidate, heap->items[0])) return;
+        heap->items[0] = candidate;
+        result_heap_sift_down(heap, 0);
+        return;
     }
-    
-    return 1;
+
+    int index = heap->count++;
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!result_is_better(heap->items[parent], candidate)) break;
+        heap->items[index] = heap->items[parent];
+        index = parent;
+    }
+    heap->items[index] = candidate;
 }
 
-int main(int argc, char **argv) {
-    int N, M, K;
-    int **matrix = NULL;
-    SubmatrixResult result, local_result;
-    double start_time, end_time;
-    int rank, size;
+// Function to offer a scored window, rejecting clearly weaker ones quickly
+static inline void result_heap_offer(ResultHeap *heap, int row, int col, double score) {
+    if (heap->count == heap->capacity && score < heap->items[0].max_log_product)
+        return;
+    SubmatrixResult candidate = {row, col, score};
+    result_heap_push(heap, candidate);
+}
 
-    // Initialize MPI
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+// Function to add every window of src to dst
+void result_heap_merge(ResultHeap *dst, const ResultHeap *src) {
+    for (int i = 0; i < src->count; i++)
+        result_heap_push(dst, src->items[i]);
+}
 
-    if (size != 2) {
-        if (rank == 0)
-            printf("Error: This program must be run with exactly 2 MPI processes.\n");
-        MPI_Finalize();
-        return 1;
+// Function to sort the heap in place, best window first. Afterwards the
+// items are an ordered list and the heap must not be pushed to again.
+void result_heap_sort(ResultHeap *heap) {
+    int count = heap->count;
+    while (heap->count > 1) {
+        SubmatrixResult weakest = heap->items[0];
+        heap->items[0] = heap->items[--heap->count];
+        result_heap_sift_down(heap, 0);
+        heap->items[heap->count] = weakest;
     }
+    heap->count = count;
+}
 
-    if (rank == 0) {
-        // Get input parameters
-        printf("Enter matrix dimensions N and M: ");
-        scanf("%d %d", &N, &M);
+// Each thread's heap while the threads of a region merge their results
+static ResultHeap *merge_slots[MAX_REPORT_THREADS];
 
-        printf("Enter submatrix size K: ");
-        scanf("%d", &K);
+// Function to merge a thread's results into top at the end of a parallel
+// region and record the thread's counters. Every thread of the region
+// calls it right after a worksharing loop declared nowait, so busy time
+// ends when the thread runs out of work. Frees local_top.
+//
+// The heaps are combined pairwise without a lock: in round r, thread t
+// merges the heap of thread t + 2^r into its own when t is a multiple of
+// 2^(r+1), so a team of T threads needs log2(T) rounds instead of T
+// merges in turn. result_is_better is a total order, so the kept windows
+// do not depend on the order of the merges. Teams nested inside another
+// parallel region fall back to a critical section.
+void merge_thread_results(ResultHeap *top, ResultHeap *local_top, double busy_start,
+                          double windows) {
+    int outermost = omp_get_level() == 1;
+    int threads = omp_get_num_threads(), thread = omp_get_thread_num();
+    double entry = omp_get_wtime(), merge_start, merge_end;
 
-        // Validate parameters
-        if (!validate_parameters(N, M, K)) {
-            MPI_Abort(MPI_COMM_WORLD, 1);
+    if (threads == 1) {
+        merge_start = entry;
+        result_heap_merge(top, local_top);
+        merge_end = omp_get_wtime();
+    } else if (outermost && threads <= MAX_REPORT_THREADS) {
+        merge_slots[thread] = local_top;
+        #pragma omp barrier
+        merge_start = omp_get_wtime();
+        for (int step = 1; step < threads; step *= 2) {
+            if (thread % (2 * step) == 0 && thread + step < threads)
+                result_heap_merge(merge_slots[thread], merge_slots[thread + step]);
+            #pragma omp barrier
+        }
+        if (thread == 0)
+            result_heap_merge(top, local_top);
+        merge_end = omp_get_wtime();
+    } else {
+        merge_start = entry;
+        #pragma omp critical
+        {
+            result_heap_merge(top, local_top);
         }
+        merge_end = omp_get_wtime();
+    }
 
-        printf("\nParameters: N=%d, M=%d, K=%d\n", N, M, K);
-        printf("Number of OpenMP threads: %d\n", omp_get_max_threads());
+    // Heaps are read by other threads until the last round is over
+    #pragma omp barrier
+    free_result_heap(local_top);
+    if (!outermost) return;
 
-        // Allocate and initialize full matrix
-        matrix = allocate_matrix(N, M);
-        generate_random_matrix(matrix, N, M);
+    if (thread < MAX_REPORT_THREADS) {
+        ThreadCounters *counters = &thread_counters[thread];
+        counters->windows += windows;
+        counters->busy += entry - busy_start;
+        counters->merge += merge_end - merge_start;
+        counters->idle += (merge_start - entry) + (omp_get_wtime() - merge_end);
+    }
 
-        if (N <= 10 && M <= 10)
-            print_matrix(matrix, N, M, 10);
-        else
-            print_matrix(matrix, N, M, 5);
+    // Thread 0 finishes the merge last; its merge time is charged to the
+    // local reduction instead of the kernel phase that is running
+    #pragma omp master
+    {
+        if (threads > MAX_REPORT_THREADS) threads = MAX_REPORT_THREADS;
+        if (threads > report_threads) report_threads = threads;
+        phase_seconds[PHASE_LOCAL_REDUCE] += merge_end - merge_start;
+        phase_seconds[current_phase] -= merge_end - merge_start;
+    }
+}
 
-        start_time = omp_get_wtime();
+// Function to run a top-R search for just the best window
+SubmatrixResult best_of_top_search(void (*search)(const Matrix *, int, ResultHeap *),
+                                   const Matrix *matrix, int K) {
+    SubmatrixResult best = {-1, -1, -INFINITY};
+    ResultHeap top = create_result_heap(1);
+    search(matrix, K, &top);
+    if (top.count > 0) best = top.items[0];
+    free_result_heap(&top);
+    return best;
+}
 
-        // Send matrix dimensions and K
-        MPI_Send(&N, 1, MPI_INT, 1, 0, MPI_COMM_WORLD);
-        MPI_Send(&M, 1, MPI_INT, 1, 0, MPI_COMM_WORLD);
-        MPI_Send(&K, 1, MPI_INT, 1, 0, MPI_COMM_WORLD);
+// SIMD kernels shared by the window engines. Each instruction set provides
+// the same three operations; get_simd_kernels() picks the widest one the
+// CPU supports at runtime.
+typedef struct {
+    const char *name;
+    // col_log/col_odd += contributions of entering minus those of leaving
+    // (leaving may be NULL)
+    void (*accumulate_rows)(double *col_log, int *col_odd, const MatrixElement *entering,
+                            const MatrixElement *leaving, int M);
+    // dst += src element-wise, for a prefix table row and its odd counts
+    void (*add_prefix_row)(double *dst_log, int *dst_odd, const double *src_log,
+                           const int *src_odd, int n);
+    // Score windows [j, j+K) for j in [0, count) from running column sums
+    // (count + K entries). Returns the first column whose score beats
+    // *best_score and updates it, or -1 if none does.
+    int (*score_windows)(const double *log_prefix, const int *odd_prefix,
+                         int count, int K, double *best_score);
+} SimdKernels;
 
-        // Send half the matrix rows to process 1
-        int half = N / 2;
-        for (int i = half; i < N; i++) {
-            MPI_Send(matrix[i], M, MPI_INT, 1, 0, MPI_COMM_WORLD);
+void accumulate_rows_scalar(double *col_log, int *col_odd, const MatrixElement *entering,
+                            const MatrixElement *leaving, int M) {
+    if (leaving == NULL) {
+        for (int j = 0; j < M; j++) {
+            col_log[j] += value_log(entering[j]);
+            col_odd[j] += value_odd(entering[j]);
         }
+        return;
+    }
+    for (int j = 0; j < M; j++) {
+        col_log[j] += value_log(entering[j]) - value_log(leaving[j]);
+        col_odd[j] += value_odd(entering[j]) - value_odd(leaving[j]);
+    }
+}
 
-        // Process 0 computes on rows 0 to half-1
-        local_result = find_best_submatrix_parallel(matrix, half, M, K);
+void add_prefix_row_scalar(double *dst_log, int *dst_odd, const double *src_log,
+                           const int *src_odd, int n) {
+    for (int j = 0; j < n; j++) {
+        dst_log[j] += src_log[j];
+        dst_odd[j] += src_odd[j];
+    }
+}
 
-    } else {
-        // Receive matrix dimensions and K
-        MPI_Recv(&N, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(&M, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(&K, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+int score_windows_scalar(const double *log_prefix, const int *odd_prefix,
+                         int count, int K, double *best_score) {
+    int best_col = -1;
+    for (int j = 0; j < count; j++) {
+        double score = log_prefix[j + K] - log_prefix[j];
+        if (odd_prefix[j + K] - odd_prefix[j] > 0 && score > *best_score) {
+            *best_score = score;
+            best_col = j;
+        }
+    }
+    return best_col;
+}
 
-        int half = N / 2;
-        matrix = allocate_matrix(N - half, M);
+// Function to pick the best lane of a vector argmax: highest score, then
+// smallest column. Lanes that never matched hold column -1.
+static int reduce_lanes(const double *scores, const long long *cols, int lanes,
+                        double *best_score) {
+    int best_col = -1;
+    double best = *best_score;
+    for (int l = 0; l < lanes; l++) {
+        if (cols[l] < 0) continue;
+        if (scores[l] > best || (scores[l] == best && best_col >= 0 && cols[l] < best_col)) {
+            best = scores[l];
+            best_col = (int)cols[l];
+        }
+    }
+    if (best_col >= 0) *best_score = best;
+    return best_col;
+}
+
+// Function to finish a vector argmax with the scalar tail [start, count)
+static int score_windows_tail(const double *log_prefix, const int *odd_prefix,
+                              int start, int count, int K, int best_col,
+                              double *best_score) {
+    int tail_col = score_windows_scalar(log_prefix + start, odd_prefix + start,
+                                        count - start, K, best_score);
+    return (tail_col >= 0) ? start + tail_col : best_col;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Function to load 8 matrix elements widened to 32-bit lanes
+__attribute__((target("avx2")))
+static inline __m256i load_elements_avx2(const MatrixElement *elements) {
+#ifdef HW2_INT8
+    return _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)elements));
+#else
+    return _mm256_loadu_si256((const __m256i *)elements);
+#endif
+}
 
-        for (int i = 0; i < N - half; i++) {
-            MPI_Recv(matrix[i], M, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+// Function to load 16 matrix elements widened to 32-bit lanes
+__attribute__((target("avx512f")))
+static inline __m512i load_elements_avx512(const MatrixElement *elements) {
+#ifdef HW2_INT8
+    return _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)elements));
+#else
+    return _mm512_loadu_si512(elements);
+#endif
+}
+
+// Function to check that all 8 values are inside MIN_VALUE..MAX_VALUE and
+// return their lookup table indices
+__attribute__((target("avx2")))
+static inline int table_indices_avx2(__m256i values, __m256i *indices) {
+    *indices = _mm256_sub_epi32(values, _mm256_set1_epi32(MIN_VALUE));
+    __m256i clamped = _mm256_min_epu32(*indices, _mm256_set1_epi32(VALUE_RANGE - 1));
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi32(clamped, *indices)) == -1;
+}
+
+__attribute__((target("avx2")))
+void accumulate_rows_avx2(double *col_log, int *col_odd, const MatrixElement *entering,
+                          const MatrixElement *leaving, int M) {
+    const __m256i one = _mm256_set1_epi32(1);
+    int j = 0;
+    for (; j + 8 <= M; j += 8) {
+        __m256i in_values = load_elements_avx2(entering + j);
+        __m256i out_values = leaving ? load_elements_avx2(leaving + j) : _mm256_set1_epi32(0);
+        __m256i in_index, out_index;
+        if (!table_indices_avx2(in_values, &in_index) ||
+            !table_indices_avx2(out_values, &out_index)) {
+            accumulate_rows_scalar(col_log + j, col_odd + j, entering + j,
+                                   leaving ? leaving + j : NULL, 8);
+            continue;
         }
 
-        local_result = find_best_submatrix_parallel(matrix, N - half, M, K);
+        // Even values look up 0, so the gathers act as masked adds
+        for (int half = 0; half < 2; half++) {
+            __m128i in_half = half ? _mm256_extracti128_si256(in_index, 1)
+                                   : _mm256_castsi256_si128(in_index);
+            __m128i out_half = half ? _mm256_extracti128_si256(out_index, 1)
+                                    : _mm256_castsi256_si128(out_index);
+            __m256d in_log = _mm256_i32gather_pd(log_table, in_half, 8);
+            __m256d out_log = leaving ? _mm256_i32gather_pd(log_table, out_half, 8)
+                                      : _mm256_setzero_pd();
+            __m256d sums = _mm256_loadu_pd(col_log + j + 4 * half);
+            sums = _mm256_add_pd(sums, _mm256_sub_pd(in_log, out_log));
+            _mm256_storeu_pd(col_log + j + 4 * half, sums);
+        }
 
-        // Adjust row to global index
-        local_result.row += half;
+        __m256i counts = _mm256_loadu_si256((const __m256i *)(col_odd + j));
+        counts = _mm256_add_epi32(counts, _mm256_and_si256(in_values, one));
+        counts = _mm256_sub_epi32(counts, _mm256_and_si256(out_values, one));
+        _mm256_storeu_si256((__m256i *)(col_odd + j), counts);
+    }
+    if (j < M)
+        accumulate_rows_scalar(col_log + j, col_odd + j, entering + j,
+                               leaving ? leaving + j : NULL, M - j);
+}
 
-        // Send local result to process 0
-        MPI_Send(&local_result, sizeof(SubmatrixResult), MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+__attribute__((target("avx2")))
+void add_prefix_row_avx2(double *dst_log, int *dst_odd, const double *src_log,
+                         const int *src_odd, int n) {
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        _mm256_storeu_pd(dst_log + j, _mm256_add_pd(_mm256_loadu_pd(dst_log + j),
+                                                    _mm256_loadu_pd(src_log + j)));
+        _mm256_storeu_pd(dst_log + j + 4, _mm256_add_pd(_mm256_loadu_pd(dst_log + j + 4),
+                                                        _mm256_loadu_pd(src_log + j + 4)));
+        _mm256_storeu_si256((__m256i *)(dst_odd + j),
+                            _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(dst_odd + j)),
+                                             _mm256_loadu_si256((const __m256i *)(src_odd + j))));
     }
+    add_prefix_row_scalar(dst_log + j, dst_odd + j, src_log + j, src_odd + j, n - j);
+}
 
-    if (rank == 0) {
-        // Receive result from process 1
-        SubmatrixResult other_result;
-        MPI_Recv(&other_result, sizeof(SubmatrixResult), MPI_BYTE, 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+__attribute__((target("avx2")))
+int score_windows_avx2(const double *log_prefix, const int *odd_prefix,
+                       int count, int K, double *best_score) {
+    __m256d best = _mm256_set1_pd(*best_score);
+    __m256i best_cols = _mm256_set1_epi64x(-1);
+    __m256i cols = _mm256_setr_epi64x(0, 1, 2, 3);
+    const __m256i step = _mm256_set1_epi64x(4);
+    const __m256d minus_inf = _mm256_set1_pd(-INFINITY);
+    int j = 0;
 
-        // Select better result
-        result = (local_result.max_log_product > other_result.max_log_product) ? local_result : other_result;
+    for (; j + 4 <= count; j += 4) {
+        __m256d score = _mm256_sub_pd(_mm256_loadu_pd(log_prefix + j + K),
+                                      _mm256_loadu_pd(log_prefix + j));
+        __m128i odd = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(odd_prefix + j + K)),
+                                    _mm_loadu_si128((const __m128i *)(odd_prefix + j)));
+        __m256d has_odd = _mm256_castsi256_pd(
+            _mm256_cvtepi32_epi64(_mm_cmpgt_epi32(odd, _mm_setzero_si128())));
+        score = _mm256_blendv_pd(minus_inf, score, has_odd);
 
-        end_time = omp_get_wtime();
+        __m256d better = _mm256_cmp_pd(score, best, _CMP_GT_OQ);
+        best = _mm256_blendv_pd(best, score, better);
+        best_cols = _mm256_blendv_epi8(best_cols, cols, _mm256_castpd_si256(better));
+        cols = _mm256_add_epi64(cols, step);
+    }
 
-        if (result.row != -1 && result.col != -1) {
-            printf("Best submatrix found at position: (%d, %d)\n", result.row, result.col);
-            printf("Log sum of odd elements: %.6f\n", result.max_log_product);
+    double lane_scores[4];
+    long long lane_cols[4];
+    _mm256_storeu_pd(lane_scores, best);
+    _mm256_storeu_si256((__m256i *)lane_cols, best_cols);
+    int best_col = reduce_lanes(lane_scores, lane_cols, 4, best_score);
+    return score_windows_tail(log_prefix, odd_prefix, j, count, K, best_col, best_score);
+}
 
-            if (N <= 20 && M <= 20)
-                print_submatrix(matrix, result.row, result.col, K);
+__attribute__((target("avx512f")))
+void accumulate_rows_avx512(double *col_log, int *col_odd, const MatrixElement *entering,
+                            const MatrixElement *leaving, int M) {
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i min_value = _mm512_set1_epi32(MIN_VALUE);
+    const __m512i range = _mm512_set1_epi32(VALUE_RANGE);
+    int j = 0;
+    for (; j + 16 <= M; j += 16) {
+        __m512i in_values = load_elements_avx512(entering + j);
+        __m512i out_values = leaving ? load_elements_avx512(leaving + j) : _mm512_setzero_si512();
+        __m512i in_index = _mm512_sub_epi32(in_values, min_value);
+        __m512i out_index = _mm512_sub_epi32(out_values, min_value);
+        if (_mm512_cmplt_epu32_mask(in_index, range) != 0xFFFF ||
+            _mm512_cmplt_epu32_mask(out_index, range) != 0xFFFF) {
+            accumulate_rows_scalar(col_log + j, col_odd + j, entering + j,
+                                   leaving ? leaving + j : NULL, 16);
+            continue;
+        }
 
-            printf("Execution time: %.6f seconds\n", end_time - start_time);
-        } else {
-            printf("No valid submatrix found with odd elements\n");
+        // 16 columns per iteration: odd lanes are added with a mask
+        __mmask16 in_odd = _mm512_test_epi32_mask(in_values, one);
+        __mmask16 out_odd = _mm512_test_epi32_mask(out_values, one);
+        for (int half = 0; half < 2; half++) {
+            __m256i in_half = half ? _mm512_extracti64x4_epi64(in_index, 1)
+                                   : _mm512_castsi512_si256(in_index);
+            __m256i out_half = half ? _mm512_extracti64x4_epi64(out_index, 1)
+                                    : _mm512_castsi512_si256(out_index);
+            __mmask8 in_mask = (__mmask8)(in_odd >> (8 * half));
+            __mmask8 out_mask = (__mmask8)(out_odd >> (8 * half));
+            __m512d in_log = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), in_mask,
+                                                      in_half, log_table, 8);
+            __m512d out_log = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), out_mask,
+                                                       out_half, log_table, 8);
+            __m512d sums = _mm512_loadu_pd(col_log + j + 8 * half);
+            sums = _mm512_add_pd(sums, _mm512_sub_pd(in_log, out_log));
+            _mm512_storeu_pd(col_log + j + 8 * half, sums);
         }
 
-        free_matrix(matrix, N);
-    } else {
-        free_matrix(matrix, N - N / 2);
+        __m512i counts = _mm512_loadu_si512(col_odd + j);
+        counts = _mm512_mask_add_epi32(counts, in_odd, counts, one);
+        counts = _mm512_mask_sub_epi32(counts, out_odd, counts, one);
+        _mm512_storeu_si512(col_odd + j, counts);
+    }
+    if (j < M)
+        accumulate_rows_scalar(col_log + j, col_odd + j, entering + j,
+                               leaving ? leaving + j : NULL, M - j);
+}
+
+__attribute__((target("avx512f")))
+void add_prefix_row_avx512(double *dst_log, int *dst_odd, const double *src_log,
+                           const int *src_odd, int n) {
+    int j = 0;
+    for (; j + 16 <= n; j += 16) {
+        _mm512_storeu_pd(dst_log + j, _mm512_add_pd(_mm512_loadu_pd(dst_log + j),
+                                                    _mm512_loadu_pd(src_log + j)));
+        _mm512_storeu_pd(dst_log + j + 8, _mm512_add_pd(_mm512_loadu_pd(dst_log + j + 8),
+                                                        _mm512_loadu_pd(src_log + j + 8)));
+        _mm512_storeu_si512(dst_odd + j, _mm512_add_epi32(_mm512_loadu_si512(dst_odd + j),
+                                                          _mm512_loadu_si512(src_odd + j)));
+    }
+    add_prefix_row_scalar(dst_log + j, dst_odd + j, src_log + j, src_odd + j, n - j);
+}
+
+__attribute__((target("avx512f")))
+int score_windows_avx512(const double *log_prefix, const int *odd_prefix,
+                         int count, int K, double *best_score) {
+    __m512d best = _mm512_set1_pd(*best_score);
+    __m512i best_cols = _mm512_set1_epi64(-1);
+    __m512i cols = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m512i step = _mm512_set1_epi64(8);
+    int j = 0;
+
+    for (; j + 8 <= count; j += 8) {
+        __m512d score = _mm512_sub_pd(_mm512_loadu_pd(log_prefix + j + K),
+                                      _mm512_loadu_pd(log_prefix + j));
+        __m256i odd = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(odd_prefix + j + K)),
+                                       _mm256_loadu_si256((const __m256i *)(odd_prefix + j)));
+        __mmask8 has_odd = _mm512_cmpgt_epi64_mask(_mm512_cvtepi32_epi64(odd),
+                                                   _mm512_setzero_si512());
+        __mmask8 better = _mm512_mask_cmp_pd_mask(has_odd, score, best, _CMP_GT_OQ);
+        best = _mm512_mask_mov_pd(best, better, score);
+        best_cols = _mm512_mask_mov_epi64(best_cols, better, cols);
+        cols = _mm512_add_epi64(cols, step);
+    }
+
+    double lane_scores[8];
+    long long lane_cols[8];
+    _mm512_storeu_pd(lane_scores, best);
+    _mm512_storeu_si512(lane_cols, best_cols);
+    int best_col = reduce_lanes(lane_scores, lane_cols, 8, best_score);
+    return score_windows_tail(log_prefix, odd_prefix, j, count, K, best_col, best_score);
+}
+
+#endif
+
+#if defined(__aarch64__)
+
+// Function to load 4 matrix elements widened to 32-bit lanes
+static inline int32x4_t load_elements_neon(const MatrixElement *elements) {
+#ifdef HW2_INT8
+    int32_t packed;
+    memcpy(&packed, elements, sizeof(packed));
+    int8x8_t bytes = vreinterpret_s8_s32(vdup_n_s32(packed));
+    return vmovl_s16(vget_low_s16(vmovl_s8(bytes)));
+#else
+    return vld1q_s32(elements);
+#endif
+}
+
+void accumulate_rows_neon(double *col_log, int *col_odd, const MatrixElement *entering,
+                          const MatrixElement *leaving, int M) {
+    const int32x4_t one = vdupq_n_s32(1);
+    int j = 0;
+    for (; j + 4 <= M; j += 4) {
+        int32x4_t in_values = load_elements_neon(entering + j);
+        int32x4_t out_values = leaving ? load_elements_neon(leaving + j) : vdupq_n_s32(0);
+        double in_log[4], out_log[4];
+
+        // NEON has no gather, so the table lookups stay scalar
+        for (int l = 0; l < 4; l++) {
+            in_log[l] = value_log(entering[j + l]);
+            out_log[l] = leaving ? value_log(leaving[j + l]) : 0.0;
+        }
+        for (int l = 0; l < 4; l += 2) {
+            float64x2_t sums = vld1q_f64(col_log + j + l);
+            sums = vaddq_f64(sums, vsubq_f64(vld1q_f64(in_log + l), vld1q_f64(out_log + l)));
+            vst1q_f64(col_log + j + l, sums);
+        }
+
+        int32x4_t counts = vld1q_s32(col_odd + j);
+        counts = vaddq_s32(counts, vandq_s32(in_values, one));
+        counts = vsubq_s32(counts, vandq_s32(out_values, one));
+        vst1q_s32(col_odd + j, counts);
+    }
+    if (j < M)
+        accumulate_rows_scalar(col_log + j, col_odd + j, entering + j,
+                               leaving ? leaving + j : NULL, M - j);
+}
+
+void add_prefix_row_neon(double *dst_log, int *dst_odd, const double *src_log,
+                         const int *src_odd, int n) {
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        vst1q_f64(dst_log + j, vaddq_f64(vld1q_f64(dst_log + j), vld1q_f64(src_log + j)));
+        vst1q_f64(dst_log + j + 2, vaddq_f64(vld1q_f64(dst_log + j + 2), vld1q_f64(src_log + j + 2)));
+        vst1q_s32(dst_odd + j, vaddq_s32(vld1q_s32(dst_odd + j), vld1q_s32(src_odd + j)));
+    }
+    add_prefix_row_scalar(dst_log + j, dst_odd + j, src_log + j, src_odd + j, n - j);
+}
+
+int score_windows_neon(const double *log_prefix, const int *odd_prefix,
+                       int count, int K, double *best_score) {
+    float64x2_t best = vdupq_n_f64(*best_score);
+    int64x2_t best_cols = vdupq_n_s64(-1);
+    int64x2_t cols = vcombine_s64(vcreate_s64(0), vcreate_s64(1));
+    const int64x2_t step = vdupq_n_s64(2);
+    const float64x2_t minus_inf = vdupq_n_f64(-INFINITY);
+    int j = 0;
+
+    for (; j + 2 <= count; j += 2) {
+        float64x2_t score = vsubq_f64(vld1q_f64(log_prefix + j + K), vld1q_f64(log_prefix + j));
+        int64x2_t odd = vmovl_s32(vsub_s32(vld1_s32(odd_prefix + j + K), vld1_s32(odd_prefix + j)));
+        score = vbslq_f64(vcgtq_s64(odd, vdupq_n_s64(0)), score, minus_inf);
+
+        uint64x2_t better = vcgtq_f64(score, best);
+        best = vbslq_f64(better, score, best);
+        best_cols = vbslq_s64(better, cols, best_cols);
+        cols = vaddq_s64(cols, step);
+    }
+
+    double lane_scores[2];
+    long long lane_cols[2];
+    vst1q_f64(lane_scores, best);
+    vst1q_s64((int64_t *)lane_cols, best_cols);
+    int best_col = reduce_lanes(lane_scores, lane_cols, 2, best_score);
+    return score_windows_tail(log_prefix, odd_prefix, j, count, K, best_col, best_score);
+}
+
+#endif
+
+// Function to get the SIMD kernels for this CPU (call outside parallel
+// regions the first time)
+const SimdKernels *get_simd_kernels(void) {
+    static const SimdKernels scalar_kernels = {
+        "scalar", accumulate_rows_scalar, add_prefix_row_scalar, score_windows_scalar
+    };
+    static const SimdKernels *selected = NULL;
+    if (selected != NULL) return selected;
+
+    selected = &scalar_kernels;
+#if defined(__x86_64__) || defined(__i386__)
+    static const SimdKernels avx2_kernels = {
+        "avx2", accumulate_rows_avx2, add_prefix_row_avx2, score_windows_avx2
+    };
+    static const SimdKernels avx512_kernels = {
+        "avx512", accumulate_rows_avx512, add_prefix_row_avx512, score_windows_avx512
+    };
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        selected = &avx512_kernels;
+    else if (__builtin_cpu_supports("avx2"))
+        selected = &avx2_kernels;
+
+    // HW2_SIMD can force a narrower instruction set for comparisons
+    const char *forced = getenv("HW2_SIMD");
+    if (forced != NULL && strcmp(forced, "scalar") == 0)
+        selected = &scalar_kernels;
+    else if (forced != NULL && strcmp(forced, "avx2") == 0 && selected == &avx512_kernels)
+        selected = &avx2_kernels;
+#elif defined(__aarch64__)
+    static const SimdKernels neon_kernels = {
+        "neon", accumulate_rows_neon, add_prefix_row_neon, score_windows_neon
+    };
+    selected = &neon_kernels;
+
+    const char *forced = getenv("HW2_SIMD");
+    if (forced != NULL && strcmp(forced, "scalar") == 0)
+        selected = &scalar_kernels;
+#endif
+    return selected;
+}
+
+// Function to pick the tile size used by find_best_submatrix_parallel.
+// Without a setting, square tiles are sized so the plane rows a tile
+// touches, (tile + K - 1)^2 doubles plus odd bytes, fill half of L2.
+TileSize choose_tile_size(int K) {
+    TileSize tile = tile_setting;
+    if (tile.rows > 0 && tile.cols > 0) return tile;
+
+    long l2_bytes = DEFAULT_L2_BYTES;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    long detected = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (detected > 0) l2_bytes = detected;
+#endif
+    int side = (int)sqrt((double)l2_bytes / 2 / (sizeof(double) + 1)) - (K - 1);
+    if (side < 8) side = 8;
+    tile.rows = side;
+    tile.cols = side;
+    return tile;
+}
+
+// Main function to find the best top->capacity submatrices using OpenMP.
+// Window positions are scheduled in rectangular tiles so windows sharing
+// rows run on the same core while those rows are still in its cache.
+void find_top_submatrices_parallel(const Matrix *matrix, int K, ResultHeap *top) {
+    int N = matrix->rows, M = matrix->cols;
+    ContributionPlane plane = build_contribution_plane(matrix);
+    TileSize tile = choose_tile_size(K);
+    int tile_grid_rows = (N - K + tile.rows) / tile.rows;
+    int tile_grid_cols = (M - K + tile.cols) / tile.cols;
+    
+    // Parallel search using OpenMP
+    #pragma omp parallel
+    {
+        double busy_start = omp_get_wtime();
+        double windows = 0.0;
+        ResultHeap local_top = create_result_heap(top->capacity);
+        
+        #pragma omp for collapse(2) schedule(dynamic) nowait
+        for (int tile_row = 0; tile_row < tile_grid_rows; tile_row++) {
+            for (int tile_col = 0; tile_col < tile_grid_cols; tile_col++) {
+                int row_end = (tile_row + 1) * tile.rows;
+                int col_end = (tile_col + 1) * tile.cols;
+                if (row_end > N - K + 1) row_end = N - K + 1;
+                if (col_end > M - K + 1) col_end = M - K + 1;
+                windows += (double)(row_end - tile_row * tile.rows) * (col_end - tile_col * tile.cols);
+
+                for (int i = tile_row * tile.rows; i < row_end; i++) {
+                    for (int j = tile_col * tile.cols; j < col_end; j++) {
+                        if (is_valid_submatrix(i, j, K, N, M)) {
+                            double current_log_product =
+                                calculate_log_product_plane(&plane, i, j, K);
+                            if (current_log_product > -INFINITY)
+                                result_heap_offer(&local_top, i, j, current_log_product);
+                        }
+                    }
+                }
+            }
+        }
+        
+        merge_thread_results(top, &local_top, busy_start, windows);
+    }
+    
+    free_contribution_plane(&plane);
+}
+
+// Function to find the single best submatrix with the naive engine
+SubmatrixResult find_best_submatrix_parallel(const Matrix *matrix, int K) {
+    return best_of_top_search(find_top_submatrices_parallel, matrix, K);
+}
+
+// Cross-rank pruning threshold of the bound engine: one double in rank
+// 0's window, raised with MPI_MAX. MPI_WIN_NULL when not shared.
+static MPI_Win prune_window = MPI_WIN_NULL;
+
+// Function to open the shared pruning threshold for one search pass.
+// Collective; a threshold must not outlive the pass it was found in.
+void open_prune_window(void) {
+    int rank;
+    double *best;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Win_allocate(rank == 0 ? sizeof(double) : 0, sizeof(double), MPI_INFO_NULL,
+                     MPI_COMM_WORLD, &best, &prune_window);
+    if (rank == 0) {
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, prune_window);
+        *best = -INFINITY;
+        MPI_Win_unlock(0, prune_window);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+// Function to close the shared pruning threshold (collective)
+void close_prune_window(void) {
+    MPI_Win_free(&prune_window);
+}
+
+// Function to publish this rank's threshold and get the highest one any
+// rank has published
+double exchange_prune_threshold(double threshold) {
+    double published;
+    MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, prune_window);
+    MPI_Fetch_and_op(&threshold, &published, MPI_DOUBLE, 0, 0, MPI_MAX, prune_window);
+    MPI_Win_unlock(0, prune_window);
+    return (published > threshold) ? published : threshold;
+}
+
+// Structure to hold a tile of window start positions and the best score
+// any of its windows could reach, in BOUND_SCALE units
+typedef struct {
+    long long bound;
+    int tile;
+} TileBound;
+
+// Function to order tiles by decreasing bound, then by index
+static int compare_tile_bounds(const void *a, const void *b) {
+    const TileBound *x = (const TileBound *)a, *y = (const TileBound *)b;
+    if (x->bound != y->bound) return (x->bound < y->bound) ? 1 : -1;
+    return x->tile - y->tile;
+}
+
+// Function to find the best top->capacity windows like the naive engine,
+// skipping windows that cannot make the list. Every element gets an
+// integer upper bound of its contribution, floor(log|x| * BOUND_SCALE) + 1
+// for odd x, and a prefix table of those bounds gives any window's bound
+// in O(1). Tiles of PRUNE_TILE x PRUNE_TILE start positions are visited
+// best bound first; a tile or a window is only scored exactly when its
+// bound can still beat the current threshold, the weakest kept score.
+// Threads share the highest threshold through an atomic, and the initial
+// thread trades it with the other ranks every PRUNE_SYNC_TILES tiles
+// while a shared window is open. Results are identical to the naive
+// engine.
+void find_top_submatrices_bound(const Matrix *matrix, int K, ResultHeap *top) {
+    int N = matrix->rows, M = matrix->cols;
+    int start_rows = N - K + 1, start_cols = M - K + 1;
+    size_t width = (size_t)M + 1;
+    ContributionPlane plane = build_contribution_plane(matrix);
+    int column_blocks = (M + PREFIX_COLUMN_BLOCK - 1) / PREFIX_COLUMN_BLOCK;
+    long long *bound_prefix = (long long *)malloc((size_t)(N + 1) * width * sizeof(long long));
+    int grid_cols = (start_cols + PRUNE_TILE - 1) / PRUNE_TILE;
+    int tile_count = ((start_rows + PRUNE_TILE - 1) / PRUNE_TILE) * grid_cols;
+    TileBound *tiles = (TileBound *)malloc(tile_count * sizeof(TileBound));
+    if (bound_prefix == NULL || tiles == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    // Largest contribution in the matrix, for the rounding slack below
+    double largest = 0.0;
+
+    Phase previous = phase_switch(PHASE_PREPROCESS);
+    #pragma omp parallel
+    {
+        #pragma omp for reduction(max : largest) schedule(static)
+        for (int i = 0; i <= N; i++) {
+            long long *row = bound_prefix + (size_t)i * width;
+            long long acc = 0;
+            row[0] = 0;
+            for (int j = 0; j < M; j++) {
+                if (i > 0) {
+                    MatrixElement value = matrix_row(matrix, i - 1)[j];
+                    if (value_odd(value)) {
+                        double contribution = value_log(value);
+                        acc += (long long)floor(contribution * BOUND_SCALE) + 1;
+                        if (contribution > largest) largest = contribution;
+                    }
+                }
+                row[j + 1] = acc;
+            }
+        }
+
+        // Rows are accumulated top to bottom over column blocks, as in
+        // build_prefix_tables
+        #pragma omp for schedule(static)
+        for (int block = 0; block < column_blocks; block++) {
+            int first_col = 1 + block * PREFIX_COLUMN_BLOCK;
+            int block_cols = (M + 1 - first_col < PREFIX_COLUMN_BLOCK) ? M + 1 - first_col
+                                                                      : PREFIX_COLUMN_BLOCK;
+            for (int i = 1; i < N; i++) {
+                long long *dst = bound_prefix + (size_t)(i + 1) * width + first_col;
+                const long long *src = bound_prefix + (size_t)i * width + first_col;
+                for (int j = 0; j < block_cols; j++)
+                    dst[j] += src[j];
+            }
+        }
+
+        #pragma omp for schedule(static)
+        for (int t = 0; t < tile_count; t++) {
+            int first_row = t / grid_cols * PRUNE_TILE, first_col = t % grid_cols * PRUNE_TILE;
+            int last_row = (first_row + PRUNE_TILE < start_rows) ? first_row + PRUNE_TILE : start_rows;
+            int last_col = (first_col + PRUNE_TILE < start_cols) ? first_col + PRUNE_TILE : start_cols;
+            long long best = 0;
+            for (int i = first_row; i < last_row; i++) {
+                const long long *upper = bound_prefix + (size_t)i * width;
+                const long long *lower = bound_prefix + (size_t)(i + K) * width;
+                for (int j = first_col; j < last_col; j++) {
+                    long long bound = lower[j + K] - lower[j] - upper[j + K] + upper[j];
+                    if (bound > best) best = bound;
+                }
+            }
+            tiles[t].bound = best;
+            tiles[t].tile = t;
+        }
+    }
+    qsort(tiles, tile_count, sizeof(TileBound), compare_tile_bounds);
+    phase_switch(previous);
+
+    // Rounding slack of an exact score summed in doubles; the bounds must
+    // stay above the computed scores, not just the true ones
+    double terms = (double)K * K;
+    double slack = terms * terms * DBL_EPSILON * largest;
+
+    double shared_threshold = -INFINITY;
+    #pragma omp parallel
+    {
+        double busy_start = omp_get_wtime();
+        double windows = 0.0;
+        ResultHeap local_top = create_result_heap(top->capacity);
+        int exchanges = omp_get_level() == 1 && omp_get_thread_num() == 0 &&
+                        prune_window != MPI_WIN_NULL;
+        int tiles_seen = 0;
+
+        #pragma omp for schedule(dynamic) nowait
+        for (int k = 0; k < tile_count; k++) {
+            double threshold;
+            #pragma omp atomic read
+            threshold = shared_threshold;
+            if (local_top.count == local_top.capacity && local_top.items[0].max_log_product > threshold)
+                threshold = local_top.items[0].max_log_product;
+            if (exchanges && ++tiles_seen % PRUNE_SYNC_TILES == 0)
+                threshold = exchange_prune_threshold(threshold);
+            if ((double)tiles[k].bound / BOUND_SCALE + slack < threshold)
+                continue;
+
+            int t = tiles[k].tile;
+            int first_row = t / grid_cols * PRUNE_TILE, first_col = t % grid_cols * PRUNE_TILE;
+            int last_row = (first_row + PRUNE_TILE < start_rows) ? first_row + PRUNE_TILE : start_rows;
+            int last_col = (first_col + PRUNE_TILE < start_cols) ? first_col + PRUNE_TILE : start_cols;
+            for (int i = first_row; i < last_row; i++) {
+                const long long *upper = bound_prefix + (size_t)i * width;
+                const long long *lower = bound_prefix + (size_t)(i + K) * width;
+                for (int j = first_col; j < last_col; j++) {
+                    long long bound = lower[j + K] - lower[j] - upper[j + K] + upper[j];
+                    if ((double)bound / BOUND_SCALE + slack < threshold)
+                        continue;
+                    double current_log_product = calculate_log_product_plane(&plane, i, j, K);
+                    windows += 1.0;
+                    if (current_log_product > -INFINITY)
+                        result_heap_offer(&local_top, i, j, current_log_product);
+                    if (local_top.count == local_top.capacity &&
+                        local_top.items[0].max_log_product > threshold)
+                        threshold = local_top.items[0].max_log_product;
+                }
+            }
+
+            // A stale or lower value written by another thread only prunes
+            // less; any thread's threshold is a valid one
+            double current;
+            #pragma omp atomic read
+            current = shared_threshold;
+            if (threshold > current) {
+                #pragma omp atomic write
+                shared_threshold = threshold;
+            }
+        }
+
+        if (exchanges)
+            exchange_prune_threshold(shared_threshold);
+        merge_thread_results(top, &local_top, busy_start, windows);
+    }
+
+    free(tiles);
+    free(bound_prefix);
+    free_contribution_plane(&plane);
+}
+
+// Structure to hold the 2D prefix sums (summed-area tables) of a matrix.
+// log_prefix[i][j] holds the sum of log|x| over odd entries of rows [0, i)
+// and columns [0, j); odd_prefix[i][j] holds the number of such entries.
+// The tables do not depend on the window size, so one build answers
+// queries for any number of window shapes.
+typedef struct {
+    double *log_prefix;
+    int *odd_prefix;
+    int rows, cols;     // Matrix dimensions; tables are (rows+1) x (cols+1)
+} PrefixTables;
+
+// Function to build the prefix tables of a matrix
+PrefixTables build_prefix_tables(const Matrix *matrix) {
+    Phase previous = phase_switch(PHASE_PREPROCESS);
+    PrefixTables tables;
+    int N = matrix->rows, M = matrix->cols;
+    size_t width = (size_t)M + 1;
+    int column_blocks = (M + PREFIX_COLUMN_BLOCK - 1) / PREFIX_COLUMN_BLOCK;
+    const SimdKernels *kernels = get_simd_kernels();
+    double *log_prefix = (double *)malloc((size_t)(N + 1) * width * sizeof(double));
+    int *odd_prefix = (int *)malloc((size_t)(N + 1) * width * sizeof(int));
+    if (log_prefix == NULL || odd_prefix == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    #pragma omp parallel
+    {
+        // Row 0 and column 0 are the zero border of the tables
+        #pragma omp for
+        for (int j = 0; j <= M; j++) {
+            log_prefix[j] = 0.0;
+            odd_prefix[j] = 0;
+        }
+
+        // Pass 1: independent running sums along each row
+        #pragma omp for
+        for (int i = 0; i < N; i++) {
+            const MatrixElement *row = matrix_row(matrix, i);
+            double *log_row = log_prefix + (size_t)(i + 1) * width;
+            int *odd_row = odd_prefix + (size_t)(i + 1) * width;
+            double log_acc = 0.0;
+            int odd_acc = 0;
+
+            log_row[0] = 0.0;
+            odd_row[0] = 0;
+            for (int j = 0; j < M; j++) {
+                log_acc += value_log(row[j]);
+                odd_acc += value_odd(row[j]);
+                log_row[j + 1] = log_acc;
+                odd_row[j + 1] = odd_acc;
+            }
+        }
+
+        // Pass 2: accumulate rows top to bottom, each thread taking blocks
+        // of PREFIX_COLUMN_BLOCK columns through the SIMD row kernel
+        #pragma omp for schedule(static)
+        for (int block = 0; block < column_blocks; block++) {
+            int first_col = 1 + block * PREFIX_COLUMN_BLOCK;
+            int block_cols = (M + 1 - first_col < PREFIX_COLUMN_BLOCK) ? M + 1 - first_col
+                                                                      : PREFIX_COLUMN_BLOCK;
+            for (int i = 1; i < N; i++) {
+                kernels->add_prefix_row(log_prefix + (size_t)(i + 1) * width + first_col,
+                                        odd_prefix + (size_t)(i + 1) * width + first_col,
+                                        log_prefix + (size_t)i * width + first_col,
+                                        odd_prefix + (size_t)i * width + first_col,
+                                        block_cols);
+            }
+        }
+    }
+
+    tables.log_prefix = log_prefix;
+    tables.odd_prefix = odd_prefix;
+    tables.rows = N;
+    tables.cols = M;
+    phase_switch(previous);
+    return tables;
+}
+
+// Function to free the prefix tables
+void free_prefix_tables(PrefixTables *tables) {
+    free(tables->log_prefix);
+    free(tables->odd_prefix);
+    tables->log_prefix = NULL;
+    tables->odd_prefix = NULL;
+}
+
+// Function to score the P x Q windows starting in row i at columns
+// [first_col, first_col + cols) of the prefix tables, offering them to top
+static inline void score_prefix_row(const PrefixTables *tables, int P, int Q, int i,
+                                    int first_col, int cols, ResultHeap *top) {
+    size_t width = (size_t)tables->cols + 1;
+    const double *log_top = tables->log_prefix + (size_t)i * width;
+    const double *log_bottom = tables->log_prefix + (size_t)(i + P) * width;
+    const int *odd_top = tables->odd_prefix + (size_t)i * width;
+    const int *odd_bottom = tables->odd_prefix + (size_t)(i + P) * width;
+
+    for (int j = first_col; j < first_col + cols; j++) {
+        int odd_count = odd_bottom[j + Q] - odd_bottom[j]
+                      - odd_top[j + Q] + odd_top[j];
+        if (odd_count == 0) continue;
+
+        double current_log_product = log_bottom[j + Q] - log_bottom[j]
+                                   - log_top[j + Q] + log_top[j];
+        result_heap_offer(top, i, j, current_log_product);
+    }
+}
+
+// Function to score every P x Q window whose top-left corner lies in the
+// first start_rows rows and start_cols columns, adding the best
+// top->capacity windows to top. Each window is scored in O(1).
+void query_prefix_tables(const PrefixTables *tables, int P, int Q,
+                         int start_rows, int start_cols, ResultHeap *top) {
+    Phase previous = phase_switch(PHASE_KERNEL);
+
+    #pragma omp parallel
+    {
+        double busy_start = omp_get_wtime();
+        double windows = 0.0;
+        ResultHeap local_top = create_result_heap(top->capacity);
+
+        #pragma omp for schedule(static) nowait
+        for (int i = 0; i < start_rows; i++) {
+            score_prefix_row(tables, P, Q, i, 0, start_cols, &local_top);
+            windows += start_cols;
+        }
+
+        merge_thread_results(top, &local_top, busy_start, windows);
+    }
+
+    phase_switch(previous);
+}
+
+// Function to find best submatrix using 2D prefix sums. Every K x K
+// window is scored in O(1), so the search is O(N*M) regardless of K.
+void find_top_submatrices_prefix(const Matrix *matrix, int K, ResultHeap *top) {
+    PrefixTables tables = build_prefix_tables(matrix);
+    query_prefix_tables(&tables, K, K, matrix->rows - K + 1, matrix->cols - K + 1, top);
+    free_prefix_tables(&tables);
+}
+
+// Function to find the single best submatrix with the prefix engine
+SubmatrixResult find_best_submatrix_prefix(const Matrix *matrix, int K) {
+    return best_of_top_search(find_top_submatrices_prefix, matrix, K);
+}
+
+// Function to find the best top->capacity K x K windows on an offload
+// device through OpenMP target regions. The contribution of every value
+// and the prefix tables are built on the device, one row per device
+// thread and then one column per device thread. Each device thread then
+// keeps the best windows of one start row, so the host merges only
+// top->capacity results per row. The log contributions come from the
+// host's lookup table and are summed in the same order as the prefix
+// engine, so both engines report identical results. Without a device the
+// target regions run on the host.
+void find_top_submatrices_gpu(const Matrix *matrix, int K, ResultHeap *top) {
+    int N = matrix->rows, M = matrix->cols;
+    int R = top->capacity;
+    if (R > GPU_ROW_RESULTS) {
+        // Long candidate lists would not fit the per-row result buffers
+        find_top_submatrices_prefix(matrix, K, top);
+        return;
+    }
+
+    int device = omp_get_default_device();
+    int stride = matrix->stride;
+    int start_rows = N - K + 1, start_cols = M - K + 1;
+    size_t width = (size_t)M + 1;
+    size_t elements = (size_t)(N - 1) * stride + M;
+    size_t results_count = (size_t)start_rows * R;
+    const MatrixElement *data = matrix->data;
+    const double *table = log_table;
+    double fixed_scale = fixed_point_scores ? ldexp(1.0, FIXED_POINT_BITS) : 0.0;
+    SubmatrixResult *results = (SubmatrixResult *)malloc(results_count * sizeof(SubmatrixResult));
+    double *log_prefix = (double *)omp_target_alloc((size_t)(N + 1) * width * sizeof(double), device);
+    int *odd_prefix = (int *)omp_target_alloc((size_t)(N + 1) * width * sizeof(int), device);
+    if (results == NULL || log_prefix == NULL || odd_prefix == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    Phase previous = phase_switch(PHASE_TRANSFER);
+    #pragma omp target enter data map(to: data[0:elements], table[0:VALUE_RANGE]) device(device)
+    phase_switch(PHASE_PREPROCESS);
+
+    // Pass 1: zero border and running sums along each row
+    #pragma omp target teams distribute parallel for device(device) is_device_ptr(log_prefix, odd_prefix)
+    for (int i = 0; i <= N; i++) {
+        double *log_row = log_prefix + (size_t)i * width;
+        int *odd_row = odd_prefix + (size_t)i * width;
+        double log_acc = 0.0;
+        int odd_acc = 0;
+
+        log_row[0] = 0.0;
+        odd_row[0] = 0;
+        for (int j = 0; j < M; j++) {
+            if (i > 0) {
+                int value = data[(size_t)(i - 1) * stride + j];
+                unsigned index = (unsigned)(value - MIN_VALUE);
+                if (index < VALUE_RANGE) {
+                    log_acc += table[index];
+                } else if (value & 1) {
+                    double contribution = log(fabs((double)value));
+                    log_acc += (fixed_scale > 0.0) ? nearbyint(contribution * fixed_scale) / fixed_scale
+                                                   : contribution;
+                }
+                odd_acc += value & 1;
+            }
+            log_row[j + 1] = log_acc;
+            odd_row[j + 1] = odd_acc;
+        }
+    }
+
+    // Pass 2: accumulate the rows top to bottom, one column per thread
+    #pragma omp target teams distribute parallel for device(device) is_device_ptr(log_prefix, odd_prefix)
+    for (int j = 1; j <= M; j++) {
+        for (int i = 1; i < N; i++) {
+            log_prefix[(size_t)(i + 1) * width + j] += log_prefix[(size_t)i * width + j];
+            odd_prefix[(size_t)(i + 1) * width + j] += odd_prefix[(size_t)i * width + j];
+        }
+    }
+    phase_switch(PHASE_KERNEL);
+
+    // Best R windows of every start row, kept sorted best first
+    #pragma omp target teams distribute parallel for device(device) is_device_ptr(log_prefix, odd_prefix) \
+        map(from: results[0:results_count])
+    for (int i = 0; i < start_rows; i++) {
+        const double *log_top = log_prefix + (size_t)i * width;
+        const double *log_bottom = log_prefix + (size_t)(i + K) * width;
+        const int *odd_top = odd_prefix + (size_t)i * width;
+        const int *odd_bottom = odd_prefix + (size_t)(i + K) * width;
+        SubmatrixResult *list = results + (size_t)i * R;
+        int count = 0;
+
+        for (int j = 0; j < start_cols; j++) {
+            int odd_count = odd_bottom[j + K] - odd_bottom[j] - odd_top[j + K] + odd_top[j];
+            if (odd_count == 0) continue;
+
+            SubmatrixResult candidate = {i, j, log_bottom[j + K] - log_bottom[j]
+                                               - log_top[j + K] + log_top[j]};
+            if (count == R && !result_is_better(candidate, list[R - 1])) continue;
+            int position = (count < R) ? count++ : R - 1;
+            while (position > 0 && result_is_better(candidate, list[position - 1])) {
+                list[position] = list[position - 1];
+                position--;
+            }
+            list[position] = candidate;
+        }
+        for (int k = count; k < R; k++)
+            list[k].row = -1;
+    }
+
+    phase_switch(PHASE_TRANSFER);
+    #pragma omp target exit data map(release: data[0:elements], table[0:VALUE_RANGE]) device(device)
+    phase_switch(previous);
+
+    for (size_t r = 0; r < results_count; r++)
+        result_heap_push(top, results[r]);
+
+    omp_target_free(log_prefix, device);
+    omp_target_free(odd_prefix, device);
+    free(results);
+}
+
+// Function to find best submatrix by sliding a window over column sums.
+// Each thread owns a strip of SLIDING_TILE_ROWS window start rows (K + tile - 1
+// matrix rows) and keeps the per-column log sum and odd count of the current
+// K rows. Moving right adds the entering column and subtracts the leaving one;
+// moving down adds the entering row and subtracts the leaving one. Scratch
+// memory is O(M) per thread.
+void find_top_submatrices_sliding(const Matrix *matrix, int K, ResultHeap *top) {
+    int N = matrix->rows, M = matrix->cols;
+    int window_rows = N - K + 1;
+    int strip_count = (window_rows + SLIDING_TILE_ROWS - 1) / SLIDING_TILE_ROWS;
+
+    #pragma omp parallel
+    {
+        double busy_start = omp_get_wtime();
+        double windows = 0.0;
+        ResultHeap local_top = create_result_heap(top->capacity);
+        double *col_log = (double *)malloc(M * sizeof(double));
+        int *col_odd = (int *)malloc(M * sizeof(int));
+        if (col_log == NULL || col_odd == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+
+        // Static like the generator and first touch, so a thread's strips
+        // are rows on its own NUMA node
+        #pragma omp for schedule(static) nowait
+        for (int strip = 0; strip < strip_count; strip++) {
+            int first_row = strip * SLIDING_TILE_ROWS;
+            int last_row = first_row + SLIDING_TILE_ROWS;
+            if (last_row > window_rows) last_row = window_rows;
+            windows += (double)(last_row - first_row) * (M - K + 1);
+
+            // Column sums of the first K rows of the strip
+            for (int j = 0; j < M; j++) {
+                col_log[j] = 0.0;
+                col_odd[j] = 0;
+            }
+            for (int i = first_row; i < first_row + K; i++) {
+                const MatrixElement *row = matrix_row(matrix, i);
+                for (int j = 0; j < M; j++) {
+                    col_log[j] += value_log(row[j]);
+                    col_odd[j] += value_odd(row[j]);
+                }
+            }
+
+            for (int i = first_row; i < last_row; i++) {
+                double log_sum = 0.0;
+                int odd_count = 0;
+                for (int j = 0; j < K; j++) {
+                    log_sum += col_log[j];
+                    odd_count += col_odd[j];
+                }
+
+                for (int j = 0; j <= M - K; j++) {
+                    if (j > 0) {
+                        log_sum += col_log[j + K - 1] - col_log[j - 1];
+                        odd_count += col_odd[j + K - 1] - col_odd[j - 1];
+                    }
+                    if (odd_count > 0)
+                        result_heap_offer(&local_top, i, j, log_sum);
+                }
+
+                // Move the column sums down one row
+                if (i + 1 < last_row) {
+                    const MatrixElement *leaving = matrix_row(matrix, i);
+                    const MatrixElement *entering = matrix_row(matrix, i + K);
+                    for (int j = 0; j < M; j++) {
+                        col_log[j] += value_log(entering[j]) - value_log(leaving[j]);
+                        col_odd[j] += value_odd(entering[j]) - value_odd(leaving[j]);
+                    }
+                }
+            }
+        }
+
+        free(col_log);
+        free(col_odd);
+
+        merge_thread_results(top, &local_top, busy_start, windows);
+    }
+
+}
+
+// Function to find the single best submatrix with the sliding engine
+SubmatrixResult find_best_submatrix_sliding(const Matrix *matrix, int K) {
+    return best_of_top_search(find_top_submatrices_sliding, matrix, K);
+}
+
+// Function to find best submatrix with the SIMD kernels. Strips of
+// SLIDING_TILE_ROWS window rows are handled as in the sliding engine, but
+// column sums are moved down 8-16 columns at a time and every row of
+// windows is scored from a running sum of the column sums with a vector
+// argmax. Scratch memory is O(M) per thread. With more than one result
+// wanted, rows are scored with scalar heap offers instead.
+void find_top_submatrices_simd(const Matrix *matrix, int K, ResultHeap *top) {
+    int N = matrix->rows, M = matrix->cols;
+    int window_rows = N - K + 1;
+    int strip_count = (window_rows + SLIDING_TILE_ROWS - 1) / SLIDING_TILE_ROWS;
+    const SimdKernels *kernels = get_simd_kernels();
+
+    #pragma omp parallel
+    {
+        double busy_start = omp_get_wtime();
+        double windows = 0.0;
+        ResultHeap local_top = create_result_heap(top->capacity);
+        double *col_log = (double *)malloc(M * sizeof(double));
+        int *col_odd = (int *)malloc(M * sizeof(int));
+        double *log_prefix = (double *)malloc((M + 1) * sizeof(double));
+        int *odd_prefix = (int *)malloc((M + 1) * sizeof(int));
+        if (col_log == NULL || col_odd == NULL || log_prefix == NULL || odd_prefix == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+
+        // Strips are scheduled as in the sliding engine
+        #pragma omp for schedule(static) nowait
+        for (int strip = 0; strip < strip_count; strip++) {
+            int first_row = strip * SLIDING_TILE_ROWS;
+            int last_row = first_row + SLIDING_TILE_ROWS;
+            if (last_row > window_rows) last_row = window_rows;
+            windows += (double)(last_row - first_row) * (M - K + 1);
+
+            // Column sums of the first K rows of the strip
+            memset(col_log, 0, M * sizeof(double));
+            memset(col_odd, 0, M * sizeof(int));
+            for (int i = first_row; i < first_row + K; i++)
+                kernels->accumulate_rows(col_log, col_odd, matrix_row(matrix, i), NULL, M);
+
+            for (int i = first_row; i < last_row; i++) {
+                log_prefix[0] = 0.0;
+                odd_prefix[0] = 0;
+                for (int j = 0; j < M; j++) {
+                    log_prefix[j + 1] = log_prefix[j] + col_log[j];
+                    odd_prefix[j + 1] = odd_prefix[j] + col_odd[j];
+                }
+
+                if (local_top.capacity == 1) {
+                    double best = local_top.count ? local_top.items[0].max_log_product : -INFINITY;
+                    int col = kernels->score_windows(log_prefix, odd_prefix, M - K + 1, K, &best);
+                    if (col >= 0)
+                        result_heap_offer(&local_top, i, col, best);
+                } else {
+                    for (int j = 0; j <= M - K; j++) {
+                        if (odd_prefix[j + K] - odd_prefix[j] > 0)
+                            result_heap_offer(&local_top, i, j, log_prefix[j + K] - log_prefix[j]);
+                    }
+                }
+
+                // Move the column sums down one row
+                if (i + 1 < last_row)
+                    kernels->accumulate_rows(col_log, col_odd, matrix_row(matrix, i + K),
+                                             matrix_row(matrix, i), M);
+            }
+        }
+
+        free(col_log);
+        free(col_odd);
+        free(log_prefix);
+        free(odd_prefix);
+
+        merge_thread_results(top, &local_top, busy_start, windows);
+    }
+
+}
+
+// Function to find the single best submatrix with the SIMD engine
+SubmatrixResult find_best_submatrix_simd(const Matrix *matrix, int K) {
+    return best_of_top_search(find_top_submatrices_simd, matrix, K);
+}
+
+// Function to split [0, total) into parts nearly equal ranges and return
+// the start and length of range index
+void partition_range(int total, int parts, int index, int *start, int *count) {
+    int base = total / parts;
+    int extra = total % parts;
+    *start = index * base + (index < extra ? index : extra);
+    *count = base + (index < extra ? 1 : 0);
+}
+
+// Function to choose a 2D process grid, giving the larger side of the
+// grid to the longer matrix axis
+void create_process_grid(int size, int N, int M, int dims[2]) {
+    dims[0] = 0;
+    dims[1] = 0;
+    MPI_Dims_create(size, 2, dims);
+    if (M > N && dims[0] > dims[1]) {
+        int tmp = dims[0];
+        dims[0] = dims[1];
+        dims[1] = tmp;
+    }
+}
+
+// Function to count the entries of a sysfs CPU or node list such as
+// "0-3,8", returns 0 if it cannot be read
+int count_sysfs_list(const char *path) {
+    char text[256];
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return 0;
+    if (fgets(text, sizeof(text), file) == NULL) text[0] = '\0';
+    fclose(file);
+
+    int count = 0;
+    char *p = text;
+    while (*p >= '0' && *p <= '9') {
+        long first = strtol(p, &p, 10), last = first;
+        if (*p == '-') last = strtol(p + 1, &p, 10);
+        count += (int)(last - first + 1);
+        if (*p == ',') p++;
+    }
+    return count;
+}
+
+// Function to give each rank its share of the host's cores when nothing
+// else sets the thread count. Ranks bound to a socket (or any subset of
+// the CPUs) already see only their own cores; unbound ranks sharing a
+// host would otherwise each start one thread per core.
+void share_node_cores(void) {
+    MPI_Comm node_comm;
+    int local_size;
+    if (getenv("OMP_NUM_THREADS") != NULL) return;
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_size(node_comm, &local_size);
+    MPI_Comm_free(&node_comm);
+
+    int online = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (local_size > 1 && omp_get_num_procs() >= online)
+        omp_set_num_threads(online / local_size > 0 ? online / local_size : 1);
+}
+
+// Function to print where every rank and OpenMP thread runs: host,
+// rank within the host, and the CPU and NUMA node of each thread. Must
+// be called on every rank.
+void report_placement(void) {
+    int rank, size, local_rank, local_size, name_length;
+    char host[MPI_MAX_PROCESSOR_NAME];
+    char line[PLACEMENT_LINE];
+    int cpus[MAX_REPORT_THREADS], nodes[MAX_REPORT_THREADS];
+    MPI_Comm node_comm;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_rank(node_comm, &local_rank);
+    MPI_Comm_size(node_comm, &local_size);
+    MPI_Comm_free(&node_comm);
+    MPI_Get_processor_name(host, &name_length);
+
+    int threads = omp_get_max_threads();
+    if (threads > MAX_REPORT_THREADS) threads = MAX_REPORT_THREADS;
+    #pragma omp parallel num_threads(threads)
+    {
+        unsigned cpu = 0, node = 0;
+        int thread = omp_get_thread_num();
+        int found = 0;
+#ifdef SYS_getcpu
+        found = syscall(SYS_getcpu, &cpu, &node, NULL) == 0;
+#endif
+        cpus[thread] = found ? (int)cpu : -1;
+        nodes[thread] = found ? (int)node : -1;
+    }
+
+    int length = snprintf(line, PLACEMENT_LINE, "Rank %d on %s (%d of %d on host): %d threads on cpu/node",
+                          rank, host, local_rank, local_size, threads);
+    for (int t = 0; t < threads && length < PLACEMENT_LINE - 1; t++)
+        length += snprintf(line + length, PLACEMENT_LINE - length, " %d/%d", cpus[t], nodes[t]);
+
+    char *lines = NULL;
+    if (rank == 0) {
+        lines = (char *)malloc((size_t)size * PLACEMENT_LINE);
+        if (lines == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    MPI_Gather(line, PLACEMENT_LINE, MPI_CHAR, lines, PLACEMENT_LINE, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        const char *places = getenv("OMP_PLACES"), *bind = getenv("OMP_PROC_BIND");
+        int numa_nodes = count_sysfs_list("/sys/devices/system/node/online");
+        if (numa_nodes <= 0) numa_nodes = 1;
+
+        printf("Placement: %d NUMA node(s) per host, OMP_PLACES=%s, OMP_PROC_BIND=%s\n",
+               numa_nodes, places ? places : "(unset)", bind ? bind : "(unset)");
+        for (int r = 0; r < size; r++)
+            printf("  %s\n", lines + (size_t)r * PLACEMENT_LINE);
+        if (local_size != numa_nodes || bind == NULL)
+            printf("Note: for one rank per socket with pinned threads run\n"
+                   "  mpiexec -np <sockets> --map-by socket --bind-to socket "
+                   "-x OMP_PLACES=cores -x OMP_PROC_BIND=close\n");
+        free(lines);
+    }
+}
+
+// Function to get the block of window start positions owned by a rank
+// when start_rows x start_cols positions are split over the grid
+RankBlock get_rank_block(int rank, const int dims[2], int start_rows, int start_cols) {
+    RankBlock block;
+    partition_range(start_rows, dims[0], rank / dims[1],
+                    &block.first_row, &block.window_rows);
+    partition_range(start_cols, dims[1], rank % dims[1],
+                    &block.first_col, &block.window_cols);
+    return block;
+}
+
+// Function to get the rows and columns of data a rank needs: its window
+// start positions plus the halo, clipped to the matrix
+void get_block_extent(const RankBlock *block, int N, int M, int halo_rows, int halo_cols,
+                      int *rows, int *cols) {
+    int has_windows = block->window_rows > 0 && block->window_cols > 0;
+    *rows = has_windows ? block->window_rows + halo_rows : 0;
+    *cols = has_windows ? block->window_cols + halo_cols : 0;
+    if (*rows > N - block->first_row) *rows = N - block->first_row;
+    if (*cols > M - block->first_col) *cols = M - block->first_col;
+}
+
+// Function to build the MPI datatype matching SubmatrixResult
+MPI_Datatype create_result_datatype(void) {
+    MPI_Datatype struct_type, result_type;
+    int block_lengths[3] = {1, 1, 1};
+    MPI_Aint offsets[3] = {
+        offsetof(SubmatrixResult, row),
+        offsetof(SubmatrixResult, col),
+        offsetof(SubmatrixResult, max_log_product)
+    };
+    MPI_Datatype types[3] = {MPI_INT, MPI_INT, MPI_DOUBLE};
+
+    MPI_Type_create_struct(3, block_lengths, offsets, types, &struct_type);
+    MPI_Type_create_resized(struct_type, 0, sizeof(SubmatrixResult), &result_type);
+    MPI_Type_commit(&result_type);
+    MPI_Type_free(&struct_type);
+    return result_type;
+}
+
+// MPI reduction operator merging ranked result lists. Each element of
+// type is a list of results sorted best first and padded with empty
+// results; the merged list keeps the best entries with the same
+// deterministic tie-break as the OpenMP merge (MAXLOC for one entry).
+void reduce_top_results(void *in, void *inout, int *len, MPI_Datatype *type) {
+    int bytes;
+    MPI_Type_size(*type, &bytes);
+    int length = bytes / (int)(2 * sizeof(int) + sizeof(double));
+
+    SubmatrixResult *merged = (SubmatrixResult *)malloc(length * sizeof(SubmatrixResult));
+    if (merged == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (int l = 0; l < *len; l++) {
+        SubmatrixResult *incoming = (SubmatrixResult *)in + (size_t)l * length;
+        SubmatrixResult *best = (SubmatrixResult *)inout + (size_t)l * length;
+        int a = 0, b = 0;
+        for (int k = 0; k < length; k++) {
+            if (result_is_better(incoming[a], best[b]))
+                merged[k] = incoming[a++];
+            else
+                merged[k] = best[b++];
+        }
+        memcpy(best, merged, length * sizeof(SubmatrixResult));
+    }
+    free(merged);
+}
+
+// Function to combine every rank's heaps into lists of the best length
+// results, sorted best first and padded with empty results, on all ranks.
+// The count heaps are reduced together in a single collective; list l
+// of lists holds the result of heap l.
+void allreduce_top_results(ResultHeap *tops, int count, SubmatrixResult *lists, int length) {
+    Phase previous = phase_switch(PHASE_GLOBAL_REDUCE);
+    MPI_Datatype result_type = create_result_datatype();
+    MPI_Datatype list_type;
+    MPI_Op top_op;
+    SubmatrixResult *local = (SubmatrixResult *)malloc((size_t)count * length * sizeof(SubmatrixResult));
+    if (local == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    for (int l = 0; l < count; l++) {
+        result_heap_sort(&tops[l]);
+        for (int k = 0; k < length; k++)
+            local[(size_t)l * length + k] = (k < tops[l].count) ? tops[l].items[k]
+                                                                : (SubmatrixResult){-1, -1, -INFINITY};
+    }
+
+    MPI_Type_contiguous(length, result_type, &list_type);
+    MPI_Type_commit(&list_type);
+    MPI_Op_create(reduce_top_results, 1, &top_op);
+    MPI_Allreduce(local, lists, count, list_type, top_op, MPI_COMM_WORLD);
+    MPI_Op_free(&top_op);
+    MPI_Type_free(&list_type);
+    MPI_Type_free(&result_type);
+    free(local);
+    phase_switch(previous);
+}
+
+// Function to check if two K x K windows share any element
+int windows_overlap(SubmatrixResult a, SubmatrixResult b, int K) {
+    return abs(a.row - b.row) < K && abs(a.col - b.col) < K;
+}
+
+// Function to greedily pick up to wanted mutually non-overlapping windows
+// from a list sorted best first, returns how many were picked. Because a
+// window is only rejected by better windows, picks made from the best L
+// windows of the matrix are the same as picks made from all of them.
+int select_non_overlapping(const SubmatrixResult *list, int length, int K,
+                           SubmatrixResult *selected, int wanted) {
+    int count = 0;
+    for (int k = 0; k < length && count < wanted; k++) {
+        if (list[k].row == -1) break;
+        int free_spot = 1;
+        for (int s = 0; s < count && free_spot; s++)
+            free_spot = !windows_overlap(list[k], selected[s], K);
+        if (free_spot)
+            selected[count++] = list[k];
+    }
+    return count;
+}
+
+// Function to run the selected search engine, adding its best
+// top->capacity windows to top
+void find_top_submatrices(SearchEngine engine, const Matrix *matrix, int K, ResultHeap *top) {
+    Phase previous = phase_switch(PHASE_KERNEL);
+    switch (engine) {
+        case ENGINE_NAIVE:
+            find_top_submatrices_parallel(matrix, K, top);
+            break;
+        case ENGINE_SLIDING:
+            find_top_submatrices_sliding(matrix, K, top);
+            break;
+        case ENGINE_SIMD:
+            find_top_submatrices_simd(matrix, K, top);
+            break;
+        case ENGINE_GPU:
+            find_top_submatrices_gpu(matrix, K, top);
+            break;
+        case ENGINE_BOUND:
+            find_top_submatrices_bound(matrix, K, top);
+            break;
+        case ENGINE_PREFIX:
+        default:
+            find_top_submatrices_prefix(matrix, K, top);
+            break;
+    }
+    phase_switch(previous);
+}
+
+// Function to run the selected search engine for the single best window
+SubmatrixResult find_best_submatrix(SearchEngine engine, const Matrix *matrix, int K) {
+    SubmatrixResult best = {-1, -1, -INFINITY};
+    ResultHeap top = create_result_heap(1);
+    find_top_submatrices(engine, matrix, K, &top);
+    if (top.count > 0) best = top.items[0];
+    free_result_heap(&top);
+    return best;
+}
+
+// Function to parse an engine name, returns -1 if unknown
+int parse_engine(const char *name) {
+    if (strcmp(name, "naive") == 0) return ENGINE_NAIVE;
+    if (strcmp(name, "prefix") == 0) return ENGINE_PREFIX;
+    if (strcmp(name, "sliding") == 0) return ENGINE_SLIDING;
+    if (strcmp(name, "simd") == 0) return ENGINE_SIMD;
+    if (strcmp(name, "gpu") == 0) return ENGINE_GPU;
+    if (strcmp(name, "bound") == 0) return ENGINE_BOUND;
+    return -1;
+}
+
+// Function to parse a comma separated list of window shapes, each either
+// K for a K x K window or PxQ for P rows and Q columns. Returns the
+// number of shapes stored in *shapes, or -1 if the list is malformed.
+int parse_window_shapes(const char *text, WindowShape **shapes) {
+    int count = 1;
+    for (const char *c = text; *c != '\0'; c++)
+        if (*c == ',') count++;
+
+    *shapes = (WindowShape *)malloc(count * sizeof(WindowShape));
+    if (*shapes == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    const char *cursor = text;
+    for (int q = 0; q < count; q++) {
+        char *end;
+        long rows = strtol(cursor, &end, 10);
+        long cols = rows;
+        if (end == cursor) return -1;
+        if (*end == 'x') {
+            cursor = end + 1;
+            cols = strtol(cursor, &end, 10);
+            if (end == cursor) return -1;
+        }
+        if (*end != (q + 1 < count ? ',' : '\0')) return -1;
+        if (rows <= 0 || cols <= 0 || rows > INT_MAX || cols > INT_MAX) return -1;
+        (*shapes)[q].rows = (int)rows;
+        (*shapes)[q].cols = (int)cols;
+        cursor = end + 1;
+    }
+    return count;
+}
+
+// Function to append every window shape of the given area that fits in an
+// N x M matrix to *shapes, skipping shapes already in the list, in order
+// of increasing rows. Returns how many shapes were added.
+int add_area_shapes(int area, int N, int M, WindowShape **shapes, int *count) {
+    int added = 0;
+    for (int rows = 1; rows <= N && rows <= area; rows++) {
+        if (area % rows != 0 || area / rows > M) continue;
+        int cols = area / rows, known = 0;
+        for (int q = 0; q < *count && !known; q++)
+            known = (*shapes)[q].rows == rows && (*shapes)[q].cols == cols;
+        if (known) continue;
+
+        *shapes = (WindowShape *)realloc(*shapes, (*count + 1) * sizeof(WindowShape));
+        if (*shapes == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        (*shapes)[*count].rows = rows;
+        (*shapes)[*count].cols = cols;
+        (*count)++;
+        added++;
+    }
+    return added;
+}
+
+// Function to get the name of an engine
+const char *engine_name(SearchEngine engine) {
+    static const char *names[] = {"naive", "prefix", "sliding", "simd", "gpu", "bound"};
+    return names[engine];
+}
+
+// Function to parse a comma separated list of engine names, returns the
+// number of engines stored in *engines or -1 if a name is unknown
+int parse_engine_list(const char *text, int **engines) {
+    int count = 1;
+    for (const char *c = text; *c != '\0'; c++)
+        if (*c == ',') count++;
+
+    char *copy = strdup(text);
+    *engines = (int *)malloc(count * sizeof(int));
+    if (copy == NULL || *engines == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    int parsed = 0;
+    for (char *name = strtok(copy, ","); name != NULL; name = strtok(NULL, ",")) {
+        int engine = parse_engine(name);
+        if (engine < 0 || parsed == count) {
+            parsed = -1;
+            break;
+        }
+        (*engines)[parsed++] = engine;
+    }
+    free(copy);
+    return (parsed == count) ? parsed : -1;
+}
+
+// Function to print matrix (for debugging small matrices)
+void print_matrix(const Matrix *matrix, int max_print) {
+    int N = matrix->rows, M = matrix->cols;
+    int print_N = (N > max_print) ? max_print : N;
+    int print_M = (M > max_print) ? max_print : M;
+    
+    printf("Matrix (%dx%d):\n", N, M);
+    for (int i = 0; i < print_N; i++) {
+        const MatrixElement *row = matrix_row(matrix, i);
+        for (int j = 0; j < print_M; j++) {
+            printf("%4d ", row[j]);
+        }
+        if (M > max_print) printf(" ...");
+        printf("\n");
+    }
+    if (N > max_print) printf("...\n");
+    printf("\n");
+}
+
+// Function to print submatrix at given position
+void print_submatrix(const Matrix *matrix, int start_row, int start_col, int K) {
+    printf("Submatrix at position (%d, %d):\n", start_row, start_col);
+    for (int i = start_row; i < start_row + K; i++) {
+        const MatrixElement *row = matrix_row(matrix, i);
+        for (int j = start_col; j < start_col + K; j++) {
+            printf("%4d ", row[j]);
+            if (is_odd(row[j])) printf("*");
+            else printf(" ");
+        }
+        printf("\n");
+    }
+    printf("(* marks odd numbers)\n\n");
+}
+
+// Function to print the valid entries of a result list as a JSON array
+void print_results_json(const SubmatrixResult *list, int count) {
+    printf("[");
+    for (int k = 0; k < count && list[k].row != -1; k++)
+        printf("%s{\"row\": %d, \"col\": %d, \"log_sum\": %.6f}", k > 0 ? ", " : "",
+               list[k].row, list[k].col, list[k].max_log_product);
+    printf("]");
+}
+
+// Function to print the command line options
+void print_usage(const char *program) {
+    printf("Usage: %s [engine] [options]\n"
+           "  --engine E          naive, prefix (default), sliding, simd, gpu or bound\n"
+           "  --size NxM          Matrix dimensions; prompted for when missing\n"
+           "  --window K|PxQ      Window size; prompted for when missing\n"
+           "  --input FILE        Search a matrix file written by --save\n"
+           "  --save FILE         Write the generated matrix to FILE and exit\n"
+           "  --seed S            Seed of the generated matrix (default %d)\n"
+           "  --threads T         OpenMP threads per rank\n"
+           "  --tile T|RxC        Window positions per tile of the naive engine\n"
+           "                      (default sized to L2, or HW2_TILE)\n"
+           "  --format text|json  Output format (default text)\n"
+           "  --print             Print the matrix and the best window\n"
+           "  --reproducible      Fixed-point scores, bit-identical for every engine,\n"
+           "                      thread count and rank count\n"
+           "  --top R             Report the best R windows\n"
+           "  --distinct          Only report non-overlapping windows\n"
+           "  --batch K1,PxQ,...  Search several window shapes in one pass (prefix engine)\n"
+           "  --area A1,A2,...    Add every window shape of each area to the batch\n"
+           "  --serve             Answer window queries from standard input\n"
+           "  --max-window W      Largest window served by --serve (default %d)\n"
+           "  --scatter           Generate on rank 0 and scatter the blocks\n"
+           "  --pipeline          Like --scatter, overlapping band transfers with the search\n"
+           "  --dynamic           Balance tiles over ranks and threads through a shared queue\n"
+           "  --checkpoint PATH   Checkpoint each rank's progress to PATH.<rank>.{0,1}\n"
+           "                      and resume from them when restarted\n"
+           "  --checkpoint-every S  Seconds between checkpoints (default %d)\n"
+           "  --report FILE       Write per-phase timings as JSON\n"
+           "  --placement         Print the host, CPU and NUMA node of every thread\n"
+           "  --verify [CASES]    Check every engine and distribution on CASES random\n"
+           "                      matrices (default %d) against the reference scan\n"
+           "  --bench             Run a benchmark sweep (see --sizes, --ks, --threads,\n"
+           "                      --engines, --warmup, --trials, --json)\n",
+           program, DEFAULT_SEED, DEFAULT_MAX_WINDOW, DEFAULT_CHECKPOINT_SECONDS,
+           DEFAULT_VERIFY_CASES);
+}
+
+// Function to validate input parameters
+int validate_parameters(int N, int M, int K) {
+    if (N <= 0 || M <= 0 || K <= 0) {
+        printf("Error: N, M, and K must be positive integers\n");
+        return 0;
+    }
+    
+    if (K > N || K > M) {
+        printf("Error: K cannot be larger than N or M\n");
+        return 0;
+    }
+    
+    return 1;
+}
+
+// Structure to hold what a search pass needs on every rank; matrix (the
+// current band or the mapped file) and source are only used on rank 0.
+// Window start positions are split for the smallest searched shape and
+// every block carries the halo of the largest one.
+typedef struct {
+    int N, M;
+    int shape_rows, shape_cols;     // Smallest window searched
+    int halo_rows, halo_cols;       // Largest window searched, minus one
+    int band_rows;
+    int dims[2];
+    int scatter;                    // Generate on rank 0 and distribute
+    int pipeline;                   // Scatter bands with non-blocking transfers
+    int dynamic;                    // Ranks claim tiles from a shared queue
+    int resume_bands;               // Bands of the rank's block already searched
+    const char *input_path;
+    MatrixFileHeader header;
+    Matrix matrix;
+    RowSource source;
+} SearchContext;
+
+// Callback run on every rank's block of data. block holds the data,
+// owned gives the window start positions the rank searches, and
+// row_offset is added to rows of owned to get global coordinates.
+typedef void (*BlockVisitor)(const Matrix *block, const RankBlock *owned,
+                             int row_offset, void *arg);
+
+// Structure to hold a single-shape search with one of the engines
+typedef struct {
+    SearchEngine engine;
+    int K;
+    ResultHeap *top;
+} EngineSearch;
+
+// Structure to hold a batch of window shapes answered from one set of
+// prefix tables; tops[q] collects the results of shapes[q]
+typedef struct {
+    const WindowShape *shapes;
+    int count;
+    ResultHeap *tops;
+} BatchSearch;
+
+// Function to add a block's results to top in global coordinates
+void push_block_results(ResultHeap *top, const ResultHeap *block_top,
+                        const RankBlock *owned, int row_offset) {
+    for (int k = 0; k < block_top->count; k++) {
+        SubmatrixResult found = block_top->items[k];
+        found.row += owned->first_row + row_offset;
+        found.col += owned->first_col;
+        result_heap_push(top, found);
+    }
+}
+
+// Block visitor running the selected engine over the block
+void search_block_engine(const Matrix *block, const RankBlock *owned, int row_offset, void *arg) {
+    EngineSearch *search = (EngineSearch *)arg;
+    ResultHeap block_top = create_result_heap(search->top->capacity);
+    find_top_submatrices(search->engine, block, search->K, &block_top);
+    push_block_results(search->top, &block_top, owned, row_offset);
+    free_result_heap(&block_top);
+}
+
+// Function to add the best windows of one shape from a block's prefix
+// tables to top. Larger shapes have fewer start positions, limited by the
+// data the block holds.
+void query_block_tables(const PrefixTables *tables, const RankBlock *owned, int row_offset,
+                        WindowShape shape, ResultHeap *top) {
+    int start_rows = tables->rows - shape.rows + 1;
+    int start_cols = tables->cols - shape.cols + 1;
+    if (start_rows > owned->window_rows) start_rows = owned->window_rows;
+    if (start_cols > owned->window_cols) start_cols = owned->window_cols;
+    if (start_rows <= 0 || start_cols <= 0) return;
+
+    ResultHeap block_top = create_result_heap(top->capacity);
+    query_prefix_tables(tables, shape.rows, shape.cols, start_rows, start_cols, &block_top);
+    push_block_results(top, &block_top, owned, row_offset);
+    free_result_heap(&block_top);
+}
+
+// Block visitor building the block's prefix tables once and querying
+// them for every shape of the batch
+void search_block_batch(const Matrix *block, const RankBlock *owned, int row_offset, void *arg) {
+    BatchSearch *batch = (BatchSearch *)arg;
+    PrefixTables tables = build_prefix_tables(block);
+    for (int q = 0; q < batch->count; q++)
+        query_block_tables(&tables, owned, row_offset, batch->shapes[q], &batch->tops[q]);
+    free_prefix_tables(&tables);
+}
+
+// Structure to hold one block kept in memory between server queries: its
+// data, the prefix tables of that data, and the best windows of every
+// tile of start positions for the last queried shape. Updates only mark
+// the tiles whose windows contain a changed cell, and only those tiles
+// are rescored by the next query of the same shape.
+typedef struct {
+    Matrix data;
+    PrefixTables tables;
+    int tables_stale;               // Data changed since the tables were built
+    RankBlock owned;
+    int row_offset;
+    WindowShape cached_shape;       // rows is 0 while nothing is cached
+    int cached_count;
+    int start_rows, start_cols;     // Start positions searched for cached_shape
+    int tile_size;
+    int tile_grid[2];
+    ResultHeap *tile_tops;
+    unsigned char *tile_dirty;
+} ResidentBlock;
+
+// Structure to hold every block a rank keeps for server mode. Bands of a
+// rank's own block are joined into one resident block, so its halo is kept
+// once; scattered bands are split over every rank and each is kept apart.
+typedef struct {
+    ResidentBlock *blocks;
+    int count, capacity;
+    int reserve_rows;               // Rows of the rank's block, 0 when scattered
+} ResidentSet;
+
+// Block visitor keeping a copy of the block for later queries, appended to
+// the last kept block when it continues it. Prefix tables are built by
+// build_resident_tables once every band is in.
+void keep_resident_block(const Matrix *block, const RankBlock *owned, int row_offset, void *arg) {
+    ResidentSet *set = (ResidentSet *)arg;
+    ResidentBlock *last = (set->count > 0) ? &set->blocks[set->count - 1] : NULL;
+    if (last != NULL && last->owned.first_col == owned->first_col &&
+        last->owned.window_cols == owned->window_cols && last->data.cols == block->cols &&
+        last->row_offset + last->owned.first_row + last->owned.window_rows ==
+            row_offset + owned->first_row &&
+        last->owned.window_rows + block->rows <= set->reserve_rows) {
+        // The band's rows start right after the last block's window rows,
+        // overwriting its halo with the same values
+        int at = last->owned.window_rows;
+        last->data.rows = at + block->rows;
+        for (int i = 0; i < block->rows; i++)
+            memcpy(matrix_row(&last->data, at + i), matrix_row(block, i),
+                   block->cols * sizeof(MatrixElement));
+        last->owned.window_rows += owned->window_rows;
+        return;
+    }
+
+    if (set->count == set->capacity) {
+        set->capacity = (set->capacity > 0) ? set->capacity * 2 : 4;
+        set->blocks = (ResidentBlock *)realloc(set->blocks, set->capacity * sizeof(ResidentBlock));
+        if (set->blocks == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    ResidentBlock *kept = &set->blocks[set->count++];
+    memset(kept, 0, sizeof(*kept));
+    kept->data = allocate_matrix((block->rows > set->reserve_rows) ? block->rows : set->reserve_rows,
+                                 block->cols);
+    kept->data.rows = block->rows;
+    for (int i = 0; i < block->rows; i++)
+        memcpy(matrix_row(&kept->data, i), matrix_row(block, i), block->cols * sizeof(MatrixElement));
+    kept->owned = *owned;
+    kept->row_offset = row_offset;
+}
+
+// Function to drop a resident block's tile cache
+void free_tile_cache(ResidentBlock *block) {
+    int tiles = block->tile_grid[0] * block->tile_grid[1];
+    for (int t = 0; t < tiles; t++)
+        free_result_heap(&block->tile_tops[t]);
+    free(block->tile_tops);
+    free(block->tile_dirty);
+    block->tile_tops = NULL;
+    block->tile_dirty = NULL;
+    block->tile_grid[0] = block->tile_grid[1] = 0;
+    block->cached_shape.rows = block->cached_shape.cols = 0;
+}
+
+// Function to build the prefix tables of every resident block once the
+// pass that kept them is over
+void build_resident_tables(ResidentSet *set) {
+    for (int b = 0; b < set->count; b++)
+        set->blocks[b].tables = build_prefix_tables(&set->blocks[b].data);
+}
+
+// Function to free every resident block
+void free_resident_set(ResidentSet *set) {
+    for (int b = 0; b < set->count; b++) {
+        free_tile_cache(&set->blocks[b]);
+        free_prefix_tables(&set->blocks[b].tables);
+        free_matrix(&set->blocks[b].data);
+    }
+    free(set->blocks);
+    set->blocks = NULL;
+    set->count = set->capacity = 0;
+}
+
+// Function to rescore one tile of a resident block's cache. With fresh
+// tables the tile is read from them; after updates a prefix table of just
+// the tile's data footprint is built from the current values instead.
+static void score_resident_tile(ResidentBlock *block, int tile) {
+    int P = block->cached_shape.rows, Q = block->cached_shape.cols;
+    int T = block->tile_size;
+    int first_row = (tile / block->tile_grid[1]) * T;
+    int first_col = (tile % block->tile_grid[1]) * T;
+    int rows = (block->start_rows - first_row < T) ? block->start_rows - first_row : T;
+    int cols = (block->start_cols - first_col < T) ? block->start_cols - first_col : T;
+    ResultHeap *top = &block->tile_tops[tile];
+
+    top->count = 0;
+    if (!block->tables_stale) {
+        for (int i = first_row; i < first_row + rows; i++)
+            score_prefix_row(&block->tables, P, Q, i, first_col, cols, top);
+        return;
+    }
+
+    Matrix footprint = matrix_view(&block->data, first_row, first_col,
+                                   rows + P - 1, cols + Q - 1);
+    PrefixTables local = build_prefix_tables(&footprint);
+    for (int i = 0; i < rows; i++)
+        score_prefix_row(&local, P, Q, i, 0, cols, top);
+    free_prefix_tables(&local);
+
+    // Shifting every entry keeps the heap order
+    for (int k = 0; k < top->count; k++) {
+        top->items[k].row += first_row;
+        top->items[k].col += first_col;
+    }
+}
+
+// Function to add a resident block's best windows of shape to top. A new
+// shape or result count rebuilds the cache (and stale tables); otherwise
+// only the tiles dirtied by updates are rescored.
+void query_resident_block(ResidentBlock *block, WindowShape shape, int count, ResultHeap *top) {
+    if (block->cached_shape.rows != shape.rows || block->cached_shape.cols != shape.cols ||
+        block->cached_count != count) {
+        free_tile_cache(block);
+        if (block->tables_stale) {
+            free_prefix_tables(&block->tables);
+            block->tables = build_prefix_tables(&block->data);
+            block->tables_stale = 0;
+        }
+
+        block->cached_shape = shape;
+        block->cached_count = count;
+        block->start_rows = block->data.rows - shape.rows + 1;
+        block->start_cols = block->data.cols - shape.cols + 1;
+        if (block->start_rows > block->owned.window_rows) block->start_rows = block->owned.window_rows;
+        if (block->start_cols > block->owned.window_cols) block->start_cols = block->owned.window_cols;
+        if (block->start_rows <= 0 || block->start_cols <= 0) return;
+
+        // Tiles at least as large as the window keep each footprint
+        // within four tiles of data
+        int T = RESIDENT_TILE;
+        if (shape.rows > T) T = shape.rows;
+        if (shape.cols > T) T = shape.cols;
+        block->tile_size = T;
+        block->tile_grid[0] = (block->start_rows + T - 1) / T;
+        block->tile_grid[1] = (block->start_cols + T - 1) / T;
+
+        int tiles = block->tile_grid[0] * block->tile_grid[1];
+        block->tile_tops = (ResultHeap *)malloc(tiles * sizeof(ResultHeap));
+        block->tile_dirty = (unsigned char *)malloc(tiles);
+        if (block->tile_tops == NULL || block->tile_dirty == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        for (int t = 0; t < tiles; t++)
+            block->tile_tops[t] = create_result_heap(count);
+        memset(block->tile_dirty, 1, tiles);
+    }
+
+    int tiles = block->tile_grid[0] * block->tile_grid[1];
+    Phase previous = phase_switch(PHASE_KERNEL);
+    #pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < tiles; t++) {
+        if (block->tile_dirty[t]) {
+            score_resident_tile(block, t);
+            block->tile_dirty[t] = 0;
+        }
+    }
+    phase_switch(previous);
+
+    for (int t = 0; t < tiles; t++)
+        push_block_results(top, &block->tile_tops[t], &block->owned, block->row_offset);
+}
+
+// Function to set cell (i, j) of the global matrix to value in a resident
+// block if the block holds it, marking the cached tiles whose windows
+// contain the cell
+void update_resident_block(ResidentBlock *block, int i, int j, int value) {
+    int r = i - block->row_offset - block->owned.first_row;
+    int c = j - block->owned.first_col;
+    if (r < 0 || r >= block->data.rows || c < 0 || c >= block->data.cols)
+        return;
+
+    matrix_row(&block->data, r)[c] = value;
+    block->tables_stale = 1;
+    if (block->tile_dirty == NULL)
+        return;
+
+    // Windows containing the cell start in [r-P+1, r] x [c-Q+1, c]
+    int T = block->tile_size;
+    int row_lo = r - block->cached_shape.rows + 1, row_hi = r;
+    int col_lo = c - block->cached_shape.cols + 1, col_hi = c;
+    if (row_lo < 0) row_lo = 0;
+    if (col_lo < 0) col_lo = 0;
+    if (row_hi >= block->start_rows) row_hi = block->start_rows - 1;
+    if (col_hi >= block->start_cols) col_hi = block->start_cols - 1;
+    for (int tr = row_lo / T; row_lo <= row_hi && tr <= row_hi / T; tr++)
+        for (int tc = col_lo / T; col_lo <= col_hi && tc <= col_hi / T; tc++)
+            block->tile_dirty[tr * block->tile_grid[1] + tc] = 1;
+}
+
+// Function to distribute the matrix (or band) held by rank 0 over the
+// process grid and run visit on every rank's block. N and M are the
+// dimensions of that matrix and must be known on every rank; the band
+// owns window starts in its first start_rows rows and row_offset is its
+// first global row.
+void distribute_and_visit(const SearchContext *ctx, const Matrix *matrix, int N, int M,
+                          int start_rows, int row_offset, BlockVisitor visit, void *arg) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    int start_cols = M - ctx->shape_cols + 1;
+    RankBlock block = get_rank_block(rank, ctx->dims, start_rows, start_cols);
+    int local_rows, local_cols;
+    get_block_extent(&block, N, M, ctx->halo_rows, ctx->halo_cols, &local_rows, &local_cols);
+    int has_windows = local_rows > 0 && local_cols > 0;
+    Phase previous = phase_switch(PHASE_TRANSFER);
+
+    // Pack every rank's block (plus halo) into one contiguous buffer and
+    // distribute it with a single collective. Process 0 owns the top-left
+    // block and searches it in place.
+    int *send_counts = NULL, *send_displs = NULL;
+    MatrixElement *send_buffer = NULL;
+    if (rank == 0) {
+        send_counts = (int *)calloc(size, sizeof(int));
+        send_displs = (int *)calloc(size, sizeof(int));
+        if (send_counts == NULL || send_displs == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+
+        size_t total = 0;
+        for (int dest = 1; dest < size; dest++) {
+            RankBlock other = get_rank_block(dest, ctx->dims, start_rows, start_cols);
+            int other_rows, other_cols;
+            get_block_extent(&other, N, M, ctx->halo_rows, ctx->halo_cols, &other_rows, &other_cols);
+            send_displs[dest] = (int)total;
+            send_counts[dest] = other_rows * other_cols;
+            total += send_counts[dest];
+        }
+
+        send_buffer = (MatrixElement *)malloc((total > 0 ? total : 1) * sizeof(MatrixElement));
+        if (send_buffer == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        for (int dest = 1; dest < size; dest++) {
+            if (send_counts[dest] == 0) continue;
+            RankBlock other = get_rank_block(dest, ctx->dims, start_rows, start_cols);
+            int other_rows, other_cols;
+            get_block_extent(&other, N, M, ctx->halo_rows, ctx->halo_cols, &other_rows, &other_cols);
+            MatrixElement *packed = send_buffer + send_displs[dest];
+            for (int i = 0; i < other_rows; i++) {
+                memcpy(packed + (size_t)i * other_cols,
+                       matrix_row(matrix, other.first_row + i) + other.first_col,
+                       other_cols * sizeof(MatrixElement));
+            }
+        }
+    }
+
+    // Other ranks receive straight into their padded rows through a
+    // strided datatype
+    Matrix local_block = {NULL, 0, 0, 0};
+    MPI_Datatype block_type = MPI_MATRIX_ELEMENT;
+    int recv_count = 0;
+    if (rank == 0) {
+        local_block = matrix_view(matrix, 0, 0, local_rows, local_cols);
+    } else if (has_windows) {
+        local_block = allocate_matrix(local_rows, local_cols);
+        MPI_Type_vector(local_rows, local_cols, local_block.stride, MPI_MATRIX_ELEMENT, &block_type);
+        MPI_Type_commit(&block_type);
+        recv_count = 1;
+    }
+
+    MPI_Scatterv(send_buffer, send_counts, send_displs, MPI_MATRIX_ELEMENT,
+                 local_block.data, recv_count, block_type, 0, MPI_COMM_WORLD);
+
+    if (block_type != MPI_MATRIX_ELEMENT)
+        MPI_Type_free(&block_type);
+    free(send_buffer);
+    free(send_counts);
+    free(send_displs);
+    phase_switch(previous);
+
+    if (has_windows)
+        visit(&local_block, &block, row_offset, arg);
+    if (rank != 0)
+        free_matrix(&local_block);
+}
+
+// Function to run visit on this rank's block of a matrix file. Every rank
+// maps only its own block plus the halo, so no data is distributed.
+void visit_file_block(const SearchContext *ctx, BlockVisitor visit, void *arg) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    RankBlock block = get_rank_block(rank, ctx->dims, ctx->N - ctx->shape_rows + 1,
+                                     ctx->M - ctx->shape_cols + 1);
+    int local_rows, local_cols;
+    get_block_extent(&block, ctx->N, ctx->M, ctx->halo_rows, ctx->halo_cols,
+                     &local_rows, &local_cols);
+    if (local_rows == 0 || local_cols == 0)
+        return;
+
+    FileMapping mapping;
+    Matrix local_block = map_matrix_file(ctx->input_path, &ctx->header, block.first_row,
+                                         block.first_col, local_rows, local_cols, &mapping);
+
+    // The mapped block is visited in bands of ctx->band_rows window rows
+    int band_rows = (ctx->band_rows < block.window_rows) ? ctx->band_rows : block.window_rows;
+    for (int band_start = ctx->resume_bands * band_rows; band_start < block.window_rows;
+         band_start += band_rows) {
+        RankBlock band = block;
+        band.first_row = block.first_row + band_start;
+        band.window_rows = (band_start + band_rows <= block.window_rows) ? band_rows
+                                                                         : block.window_rows - band_start;
+        int band_height = (band.window_rows + ctx->halo_rows < local_rows - band_start)
+                        ? band.window_rows + ctx->halo_rows : local_rows - band_start;
+
+        Matrix local_band = matrix_view(&local_block, band_start, 0, band_height, local_cols);
+        visit(&local_band, &band, 0, arg);
+    }
+    unmap_matrix_file(&mapping);
+}
+
+// Function to run visit on this rank's block of the generated matrix.
+// Every rank generates its own block, in bands of ctx->band_rows window
+// rows, so nothing is distributed; halo rows are regenerated for each
+// band rather than copied.
+void visit_generated_block(const SearchContext *ctx, BlockVisitor visit, void *arg) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    RankBlock block = get_rank_block(rank, ctx->dims, ctx->N - ctx->shape_rows + 1,
+                                     ctx->M - ctx->shape_cols + 1);
+    int local_rows, local_cols;
+    get_block_extent(&block, ctx->N, ctx->M, ctx->halo_rows, ctx->halo_cols,
+                     &local_rows, &local_cols);
+    if (local_rows == 0 || local_cols == 0)
+        return;
+
+    int band_rows = (ctx->band_rows < block.window_rows) ? ctx->band_rows : block.window_rows;
+    int max_height = (band_rows + ctx->halo_rows < local_rows) ? band_rows + ctx->halo_rows
+                                                               : local_rows;
+    Matrix buffer = allocate_matrix(max_height, local_cols);
+
+    for (int band_start = ctx->resume_bands * band_rows; band_start < block.window_rows;
+         band_start += band_rows) {
+        RankBlock band = block;
+        band.first_row = block.first_row + band_start;
+        band.window_rows = (band_start + band_rows <= block.window_rows) ? band_rows
+                                                                         : block.window_rows - band_start;
+        int band_height = (band.window_rows + ctx->halo_rows < local_rows - band_start)
+                        ? band.window_rows + ctx->halo_rows : local_rows - band_start;
+
+        Matrix local_band = matrix_view(&buffer, 0, 0, band_height, local_cols);
+        generate_block_rows(&local_band, 0, band.first_row, band.first_col, band_height);
+        visit(&local_band, &band, 0, arg);
+    }
+    free_matrix(&buffer);
+}
+
+// Function to get the height of the first band of a search
+int first_band_height(const SearchContext *ctx) {
+    return (ctx->band_rows + ctx->halo_rows < ctx->N) ? ctx->band_rows + ctx->halo_rows : ctx->N;
+}
+
+// Structure to hold one band of the pipelined scatter while it is in
+// flight: the rank's block of the band and the requests moving it
+typedef struct {
+    int band_start, band_windows;
+    RankBlock block;
+    int has_windows;
+    Matrix local;                   // The rank's block once it has arrived
+    MatrixElement *send_buffer;     // Rank 0: packed blocks of the other ranks
+    MPI_Request *requests;
+    int request_count;
+    MPI_Datatype recv_type;
+} BandTransfer;
+
+// Function to start moving band band_start to every rank. Rank 0 builds
+// the band in host from the tail of previous (NULL for the first band,
+// which is already in host), packs the other ranks' blocks and sends them;
+// the other ranks post a receive into buffer.
+void post_band_transfer(SearchContext *ctx, BandTransfer *transfer, int band_start,
+                        Matrix *host, const Matrix *previous, Matrix *buffer) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    int N = ctx->N, M = ctx->M, band_rows = ctx->band_rows;
+    int start_positions = N - ctx->shape_rows + 1;
+    int start_cols = M - ctx->shape_cols + 1;
+    int band_windows = (band_start + band_rows <= start_positions) ? band_rows
+                                                                   : start_positions - band_start;
+    int band_height = (band_windows + ctx->halo_rows < N - band_start) ? band_windows + ctx->halo_rows
+                                                                        : N - band_start;
+    int local_rows, local_cols;
+    // Messages between two ranks arrive in order; the tag only tells the
+    // two bands in flight apart
+    int tag = (band_start / band_rows) % 2;
+
+    transfer->band_start = band_start;
+    transfer->band_windows = band_windows;
+    transfer->block = get_rank_block(rank, ctx->dims, band_windows, start_cols);
+    get_block_extent(&transfer->block, band_height, M, ctx->halo_rows, ctx->halo_cols,
+                     &local_rows, &local_cols);
+    transfer->has_windows = local_rows > 0 && local_cols > 0;
+    transfer->send_buffer = NULL;
+    transfer->request_count = 0;
+    transfer->recv_type = MPI_DATATYPE_NULL;
+
+    if (rank == 0) {
+        if (previous != NULL) {
+            // The band starts band_rows below the previous one and shares
+            // its remaining rows
+            int kept = previous->rows - band_rows;
+            for (int i = 0; i < kept; i++)
+                memcpy(matrix_row(host, i), matrix_row(previous, band_rows + i),
+                       (size_t)M * sizeof(MatrixElement));
+            ctx->source.read_rows(&ctx->source, host, kept, band_height - kept);
+        }
+        host->rows = band_height;
+        Phase phase = phase_switch(PHASE_TRANSFER);
+
+        size_t total = 0;
+        for (int dest = 1; dest < size; dest++) {
+            RankBlock other = get_rank_block(dest, ctx->dims, band_windows, start_cols);
+            int other_rows, other_cols;
+            get_block_extent(&other, band_height, M, ctx->halo_rows, ctx->halo_cols,
+                             &other_rows, &other_cols);
+            if (other_rows > 0 && other_cols > 0)
+                total += (size_t)other_rows * other_cols;
+        }
+        transfer->send_buffer = (MatrixElement *)malloc((total > 0 ? total : 1) * sizeof(MatrixElement));
+        if (transfer->send_buffer == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+
+        MatrixElement *packed = transfer->send_buffer;
+        for (int dest = 1; dest < size; dest++) {
+            RankBlock other = get_rank_block(dest, ctx->dims, band_windows, start_cols);
+            int other_rows, other_cols;
+            get_block_extent(&other, band_height, M, ctx->halo_rows, ctx->halo_cols,
+                             &other_rows, &other_cols);
+            if (other_rows <= 0 || other_cols <= 0) continue;
+            for (int i = 0; i < other_rows; i++)
+                memcpy(packed + (size_t)i * other_cols,
+                       matrix_row(host, other.first_row + i) + other.first_col,
+                       other_cols * sizeof(MatrixElement));
+            MPI_Isend(packed, other_rows * other_cols, MPI_MATRIX_ELEMENT, dest, tag,
+                      MPI_COMM_WORLD, &transfer->requests[transfer->request_count++]);
+            packed += (size_t)other_rows * other_cols;
+        }
+        transfer->local = matrix_view(host, 0, 0, local_rows, local_cols);
+        phase_switch(phase);
+    } else if (transfer->has_windows) {
+        transfer->local = matrix_view(buffer, 0, 0, local_rows, local_cols);
+        MPI_Type_vector(local_rows, local_cols, buffer->stride, MPI_MATRIX_ELEMENT,
+                        &transfer->recv_type);
+        MPI_Type_commit(&transfer->recv_type);
+        MPI_Irecv(transfer->local.data, 1, transfer->recv_type, 0, tag, MPI_COMM_WORLD,
+                  &transfer->requests[transfer->request_count++]);
+    }
+}
+
+// Function to wait for the requests of a band; on rank 0 these are its
+// sends, elsewhere the receive of the rank's block
+void finish_band_transfer(BandTransfer *transfer) {
+    Phase phase = phase_switch(PHASE_TRANSFER);
+    MPI_Waitall(transfer->request_count, transfer->requests, MPI_STATUSES_IGNORE);
+    transfer->request_count = 0;
+    if (transfer->recv_type != MPI_DATATYPE_NULL)
+        MPI_Type_free(&transfer->recv_type);
+    free(transfer->send_buffer);
+    transfer->send_buffer = NULL;
+    phase_switch(phase);
+}
+
+// Function to stream the matrix from rank 0 with non-blocking transfers,
+// two bands at a time. Band b + 1 is generated, packed and posted before
+// band b is searched, so its rows travel while every rank computes and
+// only the first band's transfer is exposed. How far a transfer gets
+// while no rank is inside MPI depends on the library's asynchronous
+// progress.
+void pipeline_and_visit(SearchContext *ctx, BlockVisitor visit, void *arg) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    int start_positions = ctx->N - ctx->shape_rows + 1;
+    int band_count = (start_positions + ctx->band_rows - 1) / ctx->band_rows;
+    BandTransfer transfers[2];
+    Matrix hosts[2] = {{NULL, 0, 0, 0}, {NULL, 0, 0, 0}};
+    Matrix buffers[2] = {{NULL, 0, 0, 0}, {NULL, 0, 0, 0}};
+
+    for (int slot = 0; slot < 2; slot++) {
+        transfers[slot].requests = (MPI_Request *)malloc(size * sizeof(MPI_Request));
+        if (transfers[slot].requests == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+
+    // The first band is the largest, so its buffers fit every band
+    int first_height = first_band_height(ctx);
+    if (rank == 0) {
+        hosts[0] = ctx->matrix;
+        if (band_count > 1)
+            hosts[1] = allocate_matrix(first_height, ctx->M);
+    } else {
+        RankBlock block = get_rank_block(rank, ctx->dims, ctx->band_rows < start_positions
+                                         ? ctx->band_rows : start_positions,
+                                         ctx->M - ctx->shape_cols + 1);
+        int rows, cols;
+        get_block_extent(&block, first_height, ctx->M, ctx->halo_rows, ctx->halo_cols, &rows, &cols);
+        if (rows > 0 && cols > 0) {
+            buffers[0] = allocate_matrix(rows, cols);
+            if (band_count > 1)
+                buffers[1] = allocate_matrix(rows, cols);
+        }
+    }
+
+    post_band_transfer(ctx, &transfers[0], 0, &hosts[0], NULL, &buffers[0]);
+    for (int b = 0; b < band_count; b++) {
+        int slot = b % 2;
+        BandTransfer *current = &transfers[slot];
+
+        if (b + 1 < band_count)
+            post_band_transfer(ctx, &transfers[1 - slot], (b + 1) * ctx->band_rows,
+                               &hosts[1 - slot], &hosts[slot], &buffers[1 - slot]);
+        if (rank != 0)
+            finish_band_transfer(current);
+        if (current->has_windows)
+            visit(&current->local, &current->block, current->band_start, arg);
+        if (rank == 0)
+            finish_band_transfer(current);
+    }
+
+    // hosts[0] is ctx->matrix; a later pass starts again from the top
+    if (rank == 0)
+        free_matrix(&hosts[1]);
+    for (int slot = 0; slot < 2; slot++) {
+        free_matrix(&buffers[slot]);
+        free(transfers[slot].requests);
+    }
+}
+
+// Function to run one full pass over the matrix, calling visit on every
+// rank's block of every band
+void search_pass(SearchContext *ctx, BlockVisitor visit, void *arg) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    int N = ctx->N, M = ctx->M, band_rows = ctx->band_rows;
+    int start_positions = N - ctx->shape_rows + 1;
+
+    if (ctx->input_path != NULL) {
+        // Every rank maps its own block of the file
+        visit_file_block(ctx, visit, arg);
+        return;
+    }
+    if (!ctx->scatter) {
+        // Every rank generates its own block of the matrix
+        visit_generated_block(ctx, visit, arg);
+        return;
+    }
+
+    // A repeated pass over a streamed matrix starts again from its first
+    // band. Passes of several bands overwrite it even when the first band
+    // already reaches the last row, so those always read it again.
+    int band_height = first_band_height(ctx);
+    if (rank == 0 && (ctx->source.next_row != band_height || band_rows < start_positions)) {
+        ctx->source.next_row = 0;
+        ctx->source.read_rows(&ctx->source, &ctx->matrix, 0, band_height);
+    }
+    if (ctx->pipeline) {
+        pipeline_and_visit(ctx, visit, arg);
+        return;
+    }
+
+    // Search band by band, keeping only the running best. Consecutive
+    // bands overlap by the halo rows.
+    for (int band_start = 0; band_start < start_positions; band_start += band_rows) {
+        int band_windows = (band_start + band_rows <= start_positions) ? band_rows
+                                                                       : start_positions - band_start;
+        int previous_height = band_height;
+        band_height = (band_windows + ctx->halo_rows < N - band_start) ? band_windows + ctx->halo_rows
+                                                                        : N - band_start;
+        Matrix band = {NULL, 0, 0, 0};
+
+        if (rank == 0) {
+            if (band_start > 0) {
+                int kept = previous_height - band_rows;
+                memmove(matrix_row(&ctx->matrix, 0), matrix_row(&ctx->matrix, band_rows),
+                        (size_t)kept * ctx->matrix.stride * sizeof(MatrixElement));
+                ctx->source.read_rows(&ctx->source, &ctx->matrix, kept, band_height - kept);
+            }
+            band = matrix_view(&ctx->matrix, 0, 0, band_height, M);
+        }
+
+        distribute_and_visit(ctx, &band, band_height, M, band_windows, band_start, visit, arg);
+    }
+}
+
+// Function to claim count tiles from the shared work queue, returns the
+// first one. The counter lives in rank 0's window; MPI_Fetch_and_op
+// hands every tile to exactly one thread of one rank.
+int claim_tiles(MPI_Win queue, int count) {
+    int first;
+    Phase previous = phase_switch(PHASE_TRANSFER);
+    MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, queue);
+    MPI_Fetch_and_op(&count, &first, MPI_INT, 0, 0, MPI_SUM, queue);
+    MPI_Win_unlock(0, queue);
+    phase_switch(previous);
+    return first;
+}
+
+// Function to run visit on tile t of a dynamic pass, a block of at most
+// tile_size window start positions, generated or mapped with its halo.
+// Returns the number of start positions in the tile.
+static double visit_dynamic_tile(const SearchContext *ctx, int t, const int tile_grid[2],
+                               const int tile_size[2], BlockVisitor visit, void *arg) {
+    int start_rows = ctx->N - ctx->shape_rows + 1;
+    int start_cols = ctx->M - ctx->shape_cols + 1;
+    RankBlock owned;
+    owned.first_row = t / tile_grid[1] * tile_size[0];
+    owned.first_col = t % tile_grid[1] * tile_size[1];
+    owned.window_rows = (start_rows - owned.first_row < tile_size[0])
+                      ? start_rows - owned.first_row : tile_size[0];
+    owned.window_cols = (start_cols - owned.first_col < tile_size[1])
+                      ? start_cols - owned.first_col : tile_size[1];
+    int rows, cols;
+    get_block_extent(&owned, ctx->N, ctx->M, ctx->halo_rows, ctx->halo_cols, &rows, &cols);
+
+    if (ctx->input_path != NULL) {
+        FileMapping mapping;
+        Matrix block = map_matrix_file(ctx->input_path, &ctx->header, owned.first_row,
+                                       owned.first_col, rows, cols, &mapping);
+        visit(&block, &owned, 0, arg);
+        unmap_matrix_file(&mapping);
+    } else {
+        Matrix block = allocate_matrix(rows, cols);
+        generate_block_rows(&block, 0, owned.first_row, owned.first_col, rows);
+        visit(&block, &owned, 0, arg);
+        free_matrix(&block);
+    }
+    return (double)owned.window_rows * owned.window_cols;
+}
+
+// Function to run one pass over the matrix as a queue of tiles of window
+// start positions instead of one fixed block per rank. Tiles are
+// DYNAMIC_TILE positions a side, or DYNAMIC_HALO_RATIO times the halo if
+// that is larger, so the halo every tile generates or maps again stays a
+// small share of its work. Every thread claims its next tile as soon as
+// it is done with the last, so a slow thread or a busy rank simply claims
+// fewer, and calls visit with thread_args[thread], so visitors need no
+// locking. Without MPI_THREAD_SERIALIZED the initial thread claims the
+// tiles one by one and the engines use the threads within each tile. Only
+// matrices every rank can produce on its own (generated or from a file)
+// can be searched this way.
+void dynamic_pass(const SearchContext *ctx, BlockVisitor visit, void **thread_args) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    int start_rows = ctx->N - ctx->shape_rows + 1;
+    int start_cols = ctx->M - ctx->shape_cols + 1;
+    int tile_size[2] = {DYNAMIC_TILE, DYNAMIC_TILE};
+    if (tile_size[0] < DYNAMIC_HALO_RATIO * ctx->halo_rows)
+        tile_size[0] = DYNAMIC_HALO_RATIO * ctx->halo_rows;
+    if (tile_size[1] < DYNAMIC_HALO_RATIO * ctx->halo_cols)
+        tile_size[1] = DYNAMIC_HALO_RATIO * ctx->halo_cols;
+    int tile_grid[2] = {(start_rows + tile_size[0] - 1) / tile_size[0],
+                        (start_cols + tile_size[1] - 1) / tile_size[1]};
+    int tile_count = tile_grid[0] * tile_grid[1];
+    int threads = omp_get_max_threads();
+
+    int *counter;
+    MPI_Win queue;
+    MPI_Win_allocate(rank == 0 ? sizeof(int) : 0, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD,
+                     &counter, &queue);
+    if (rank == 0) {
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, queue);
+        *counter = 0;
+        MPI_Win_unlock(0, queue);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    Phase previous = phase_switch(PHASE_KERNEL);
+    if (mpi_thread_level < MPI_THREAD_SERIALIZED) {
+        for (int t = claim_tiles(queue, 1); t < tile_count; t = claim_tiles(queue, 1))
+            visit_dynamic_tile(ctx, t, tile_grid, tile_size, visit, thread_args[0]);
+    } else {
+        #pragma omp parallel num_threads(threads)
+        {
+            int thread = omp_get_thread_num();
+            for (;;) {
+                // MPI calls are serialized, not concurrent
+                int t;
+                #pragma omp critical(dynamic_queue)
+                t = claim_tiles(queue, 1);
+                if (t >= tile_count) break;
+
+                double tile_start = omp_get_wtime();
+                double windows = visit_dynamic_tile(ctx, t, tile_grid, tile_size, visit,
+                                                    thread_args[thread]);
+                if (thread < MAX_REPORT_THREADS) {
+                    thread_counters[thread].windows += windows;
+                    thread_counters[thread].busy += omp_get_wtime() - tile_start;
+                }
+            }
+        }
+        if (threads > report_threads)
+            report_threads = threads < MAX_REPORT_THREADS ? threads : MAX_REPORT_THREADS;
+    }
+    phase_switch(previous);
+
+    MPI_Win_free(&queue);
+}
+
+// Function to run an engine search as a dynamic pass. Every thread
+// collects its tiles' results separately; they are merged at the end.
+void dynamic_search_engine(const SearchContext *ctx, EngineSearch *search) {
+    int threads = omp_get_max_threads();
+    EngineSearch *searches = (EngineSearch *)malloc(threads * sizeof(EngineSearch));
+    ResultHeap *tops = (ResultHeap *)malloc(threads * sizeof(ResultHeap));
+    void **args = (void **)malloc(threads * sizeof(void *));
+    if (searches == NULL || tops == NULL || args == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (int t = 0; t < threads; t++) {
+        tops[t] = create_result_heap(search->top->capacity);
+        searches[t] = *search;
+        searches[t].top = &tops[t];
+        args[t] = &searches[t];
+    }
+
+    dynamic_pass(ctx, search_block_engine, args);
+
+    for (int t = 0; t < threads; t++) {
+        result_heap_merge(search->top, &tops[t]);
+        free_result_heap(&tops[t]);
+    }
+    free(searches);
+    free(tops);
+    free(args);
+}
+
+// Function to run a batch search as a dynamic pass, with one set of
+// result heaps per thread
+void dynamic_search_batch(const SearchContext *ctx, BatchSearch *batch) {
+    int threads = omp_get_max_threads();
+    BatchSearch *batches = (BatchSearch *)malloc(threads * sizeof(BatchSearch));
+    ResultHeap *tops = (ResultHeap *)malloc((size_t)threads * batch->count * sizeof(ResultHeap));
+    void **args = (void **)malloc(threads * sizeof(void *));
+    if (batches == NULL || tops == NULL || args == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (int t = 0; t < threads; t++) {
+        batches[t] = *batch;
+        batches[t].tops = tops + (size_t)t * batch->count;
+        for (int q = 0; q < batch->count; q++)
+            batches[t].tops[q] = create_result_heap(batch->tops[q].capacity);
+        args[t] = &batches[t];
+    }
+
+    dynamic_pass(ctx, search_block_batch, args);
+
+    for (int t = 0; t < threads; t++) {
+        for (int q = 0; q < batch->count; q++) {
+            result_heap_merge(&batch->tops[q], &batches[t].tops[q]);
+            free_result_heap(&batches[t].tops[q]);
+        }
+    }
+    free(batches);
+    free(tops);
+    free(args);
+}
+
+// Header of a checkpoint file: a rank's progress through the bands of its
+// block and its best results so far. It is followed by count results and
+// a 64-bit FNV-1a hash of everything before it, so torn writes are caught.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sequence;
+    uint64_t seed;          // Generator seed, 0 for file input
+    uint64_t data_hash;     // FNV-1a of the file rows searched, 0 for generated input
+    int32_t N, M, K, ranks;
+    int32_t band_rows;
+    int32_t capacity;       // Length of the result list being searched for
+    int32_t fixed_point;
+    int32_t from_file;
+    int32_t bands_done;
+    int32_t count;
+} CheckpointHeader;
+
+// Structure to hold a rank's checkpoints of a search. Each rank alternates
+// between two files, path.<rank>.0 and path.<rank>.1, so the last complete
+// checkpoint survives a crash while the next one is being written. Writes
+// are non-blocking MPI-IO and only waited for at the next checkpoint.
+typedef struct {
+    const char *path;       // File name prefix, NULL when off
+    double interval;        // Seconds between checkpoints
+    double last_write;
+    uint64_t sequence;      // Number of the next checkpoint
+    int bands_done;
+    uint64_t data_hash;     // FNV-1a of the file rows of the bands done
+    int resumed;            // Set if the search resumed from a checkpoint
+    int pending;
+    MPI_File file;
+    MPI_Request request;
+    unsigned char *buffer;
+} Checkpoint;
+
+// Structure to hold an engine search that checkpoints its progress
+typedef struct {
+    EngineSearch search;
+    Checkpoint *checkpoint;
+    CheckpointHeader params;
+} CheckpointedSearch;
+
+// Function to continue a 64-bit FNV-1a hash over more bytes
+static uint64_t fnv1a64_update(uint64_t hash, const void *data, size_t bytes) {
+    const unsigned char *c = (const unsigned char *)data;
+    for (size_t i = 0; i < bytes; i++)
+        hash = (hash ^ c[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+// Function to hash bytes with 64-bit FNV-1a
+static uint64_t fnv1a64(const void *data, size_t bytes) {
+    return fnv1a64_update(FNV1A64_OFFSET, data, bytes);
+}
+
+// Function to continue a hash over rows of a band, each with all the
+// band's columns
+static uint64_t hash_band_rows(uint64_t hash, const Matrix *block, int row_offset, int rows) {
+    for (int i = 0; i < rows; i++)
+        hash = fnv1a64_update(hash, matrix_row(block, row_offset + i),
+                              (size_t)block->cols * sizeof(MatrixElement));
+    return hash;
+}
+
+// Function to hash the first bands of this rank's block of the matrix file,
+// halo rows included, band by band as visit_file_block hands them to
+// search_block_checkpointed
+uint64_t hash_file_bands(const SearchContext *ctx, int bands) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    RankBlock block = get_rank_block(rank, ctx->dims, ctx->N - ctx->shape_rows + 1,
+                                     ctx->M - ctx->shape_cols + 1);
+    int local_rows, local_cols;
+    get_block_extent(&block, ctx->N, ctx->M, ctx->halo_rows, ctx->halo_cols,
+                     &local_rows, &local_cols);
+    if (local_rows == 0 || local_cols == 0)
+        return FNV1A64_OFFSET;
+
+    Phase previous = phase_switch(PHASE_CHECKPOINT);
+    FileMapping mapping;
+    Matrix local_block = map_matrix_file(ctx->input_path, &ctx->header, block.first_row,
+                                         block.first_col, local_rows, local_cols, &mapping);
+    uint64_t hash = FNV1A64_OFFSET;
+    int band_rows = (ctx->band_rows < block.window_rows) ? ctx->band_rows : block.window_rows;
+    for (int band_start = 0; bands > 0 && band_start < block.window_rows;
+         band_start += band_rows, bands--) {
+        int window_rows = (band_start + band_rows <= block.window_rows) ? band_rows
+                                                                        : block.window_rows - band_start;
+        int band_height = (window_rows + ctx->halo_rows < local_rows - band_start)
+                        ? window_rows + ctx->halo_rows : local_rows - band_start;
+        hash = hash_band_rows(hash, &local_block, band_start, band_height);
+    }
+    unmap_matrix_file(&mapping);
+    phase_switch(previous);
+    return hash;
+}
+
+// Function to get the name of one of the rank's checkpoint files
+static void checkpoint_file_name(const Checkpoint *checkpoint, int slot, char *name, size_t length) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    snprintf(name, length, "%s.%d.%d", checkpoint->path, rank, slot);
+}
+
+// Function to wait for the checkpoint being written, if any
+void finish_checkpoint(Checkpoint *checkpoint) {
+    if (!checkpoint->pending) return;
+    Phase previous = phase_switch(PHASE_CHECKPOINT);
+    MPI_Wait(&checkpoint->request, MPI_STATUS_IGNORE);
+    MPI_File_close(&checkpoint->file);
+    checkpoint->pending = 0;
+    phase_switch(previous);
+}
+
+// Function to start writing a checkpoint of the bands done and top. The
+// data is copied, so the search goes on while it is written.
+void write_checkpoint(Checkpoint *checkpoint, const CheckpointHeader *params, const ResultHeap *top) {
+    finish_checkpoint(checkpoint);
+    Phase previous = phase_switch(PHASE_CHECKPOINT);
+
+    CheckpointHeader header = *params;
+    header.sequence = checkpoint->sequence;
+    header.bands_done = checkpoint->bands_done;
+    if (header.from_file)
+        header.data_hash = checkpoint->data_hash;
+    header.count = top->count;
+    size_t results = (size_t)top->count * sizeof(SubmatrixResult);
+    size_t bytes = sizeof(header) + results + sizeof(uint64_t);
+    checkpoint->buffer = (unsigned char *)realloc(checkpoint->buffer, bytes);
+    if (checkpoint->buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    memcpy(checkpoint->buffer, &header, sizeof(header));
+    memcpy(checkpoint->buffer + sizeof(header), top->items, results);
+    uint64_t hash = fnv1a64(checkpoint->buffer, bytes - sizeof(uint64_t));
+    memcpy(checkpoint->buffer + bytes - sizeof(uint64_t), &hash, sizeof(hash));
+
+    char name[PATH_MAX];
+    checkpoint_file_name(checkpoint, (int)(checkpoint->sequence % 2), name, sizeof(name));
+    if (MPI_File_open(MPI_COMM_SELF, name, MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL,
+                      &checkpoint->file) != MPI_SUCCESS) {
+        printf("Error: Cannot write checkpoint '%s', checkpoints are off\n", name);
+        checkpoint->path = NULL;
+    } else {
+        MPI_File_set_size(checkpoint->file, (MPI_Offset)bytes);
+        MPI_File_iwrite_at(checkpoint->file, 0, checkpoint->buffer, (int)bytes, MPI_BYTE,
+                           &checkpoint->request);
+        checkpoint->pending = 1;
+        checkpoint->sequence++;
+    }
+    checkpoint->last_write = omp_get_wtime();
+    phase_switch(previous);
+}
+
+// Function to read the rank's newest complete checkpoint of the search
+// described by params, whatever its capacity. Returns its header's
+// capacity, with the header in *found and its results in *items, or 0 if
+// there is none.
+int load_checkpoint(const Checkpoint *checkpoint, const CheckpointHeader *params,
+                    CheckpointHeader *found, SubmatrixResult **items) {
+    Phase previous = phase_switch(PHASE_CHECKPOINT);
+    int capacity = 0;
+    *items = NULL;
+
+    for (int slot = 0; slot < 2; slot++) {
+        char name[PATH_MAX];
+        checkpoint_file_name(checkpoint, slot, name, sizeof(name));
+        FILE *file = fopen(name, "rb");
+        if (file == NULL) continue;
+
+        CheckpointHeader header;
+        int ok = fread(&header, sizeof(header), 1, file) == 1 &&
+                 header.magic == CHECKPOINT_MAGIC && header.version == CHECKPOINT_VERSION &&
+                 header.seed == params->seed && header.N == params->N && header.M == params->M &&
+                 header.K == params->K && header.ranks == params->ranks &&
+                 header.band_rows == params->band_rows &&
+                 header.fixed_point == params->fixed_point &&
+                 header.from_file == params->from_file && header.capacity > 0 &&
+                 header.count >= 0 && header.count <= header.capacity && header.bands_done >= 0 &&
+                 (capacity == 0 || header.sequence > found->sequence);
+
+        size_t bytes = sizeof(header) + (size_t)(ok ? header.count : 0) * sizeof(SubmatrixResult);
+        unsigned char *buffer = ok ? (unsigned char *)malloc(bytes) : NULL;
+        uint64_t hash;
+        if (ok) {
+            ok = buffer != NULL && fseek(file, 0, SEEK_SET) == 0 &&
+                 fread(buffer, 1, bytes, file) == bytes &&
+                 fread(&hash, sizeof(hash), 1, file) == 1 && hash == fnv1a64(buffer, bytes);
+        }
+        fclose(file);
+        if (ok) {
+            free(*items);
+            *items = (SubmatrixResult *)malloc((size_t)(header.count + 1) * sizeof(SubmatrixResult));
+            if (*items == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+            memcpy(*items, buffer + sizeof(header), (size_t)header.count * sizeof(SubmatrixResult));
+            *found = header;
+            capacity = header.capacity;
+        }
+        free(buffer);
+    }
+    phase_switch(previous);
+    return capacity;
+}
+
+// Function to remove the rank's checkpoint files once the search is done
+void remove_checkpoints(Checkpoint *checkpoint) {
+    finish_checkpoint(checkpoint);
+    for (int slot = 0; slot < 2 && checkpoint->path != NULL; slot++) {
+        char name[PATH_MAX];
+        checkpoint_file_name(checkpoint, slot, name, sizeof(name));
+        unlink(name);
+    }
+    free(checkpoint->buffer);
+    checkpoint->buffer = NULL;
+}
+
+// Block visitor running the selected engine over a band and starting a
+// checkpoint of the rank's results when the interval is over. Every row a
+// band of a matrix file holds is hashed, halo rows included, so a resume
+// from a file that differs in any row the bands done read is caught.
+void search_block_checkpointed(const Matrix *block, const RankBlock *owned, int row_offset,
+                               void *arg) {
+    CheckpointedSearch *run = (CheckpointedSearch *)arg;
+    if (run->params.from_file)
+        run->checkpoint->data_hash = hash_band_rows(run->checkpoint->data_hash, block,
+                                                    row_offset, block->rows - row_offset);
+    search_block_engine(block, owned, row_offset, &run->search);
+    run->checkpoint->bands_done++;
+    if (run->checkpoint->path != NULL &&
+        omp_get_wtime() - run->checkpoint->last_write >= run->checkpoint->interval)
+        write_checkpoint(run->checkpoint, &run->params, run->search.top);
+}
+
+// Function to describe a search of ctx's K x K windows, everything but its
+// capacity, for the header of its checkpoints
+CheckpointHeader checkpoint_params(const SearchContext *ctx, int K) {
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    CheckpointHeader params;
+    memset(&params, 0, sizeof(params));
+    params.magic = CHECKPOINT_MAGIC;
+    params.version = CHECKPOINT_VERSION;
+    params.seed = (ctx->input_path != NULL) ? 0 : generator_seed;
+    params.N = ctx->N;
+    params.M = ctx->M;
+    params.K = K;
+    params.ranks = size;
+    params.band_rows = ctx->band_rows;
+    params.fixed_point = fixed_point_scores;
+    params.from_file = ctx->input_path != NULL;
+    return params;
+}
+
+// Function to run a full single-shape search of K x K windows and leave
+// the best top_count windows (mutually non-overlapping with distinct) in
+// selected on every rank, returns how many were found. Must be called on
+// every rank. With a checkpoint (NULL for none), every rank resumes from
+// its last checkpoint of the same search, checkpoints its progress band
+// by band and removes its checkpoints when the search is done. Ranks search
+// their blocks independently, so each may resume from a different band.
+int search_top_windows(SearchContext *ctx, SearchEngine engine, int K, int top_count,
+                       int distinct, SubmatrixResult *selected, Checkpoint *checkpoint) {
+    // Non-overlapping picks are made greedily from a longer candidate list,
+    // kept in the same single pass. Each pick hides at most (2K-1)^2
+    // windows, itself included, so the last pick is always among the best
+    // (top_count-1)*(2K-1)^2 + 1 windows.
+    long long total_windows = (long long)(ctx->N - K + 1) * (ctx->M - K + 1);
+    long long length = distinct ? (long long)(top_count - 1) * (2 * K - 1) * (2 * K - 1) + 1
+                                : top_count;
+    if (length > total_windows) length = total_windows;
+    if (length > INT_MAX / (int)sizeof(SubmatrixResult))
+        length = INT_MAX / (int)sizeof(SubmatrixResult);
+    int list_length = (int)length;
+
+    ResultHeap top = create_result_heap(list_length);
+    EngineSearch search = {engine, K, &top};
+    SubmatrixResult *list = (SubmatrixResult *)malloc(list_length * sizeof(SubmatrixResult));
+    if (list == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    CheckpointedSearch run;
+    ctx->resume_bands = 0;
+    if (checkpoint != NULL) {
+        CheckpointHeader found;
+        SubmatrixResult *restored = NULL;
+        run.search = search;
+        run.checkpoint = checkpoint;
+        run.params = checkpoint_params(ctx, K);
+        run.params.capacity = list_length;
+        checkpoint->resumed = 0;
+        checkpoint->sequence = 0;
+        checkpoint->bands_done = 0;
+        checkpoint->data_hash = FNV1A64_OFFSET;
+        checkpoint->last_write = omp_get_wtime();
+
+        // A checkpoint of file input is only kept if the rows it covers
+        // are still the same
+        int capacity = load_checkpoint(checkpoint, &run.params, &found, &restored);
+        if (capacity == list_length &&
+            (!run.params.from_file || hash_file_bands(ctx, found.bands_done) == found.data_hash)) {
+            for (int k = 0; k < found.count; k++)
+                result_heap_push(&top, restored[k]);
+            checkpoint->bands_done = ctx->resume_bands = found.bands_done;
+            checkpoint->data_hash = found.data_hash;
+            checkpoint->sequence = found.sequence + 1;
+            checkpoint->resumed = 1;
+        }
+        free(restored);
+    }
+
+    // The bound engine's ranks share their thresholds within the pass
+    if (engine == ENGINE_BOUND)
+        open_prune_window();
+    if (ctx->dynamic)
+        dynamic_search_engine(ctx, &search);
+    else if (checkpoint != NULL)
+        search_pass(ctx, search_block_checkpointed, &run);
+    else
+        search_pass(ctx, search_block_engine, &search);
+    if (engine == ENGINE_BOUND)
+        close_prune_window();
+    ctx->resume_bands = 0;
+
+    // Combine all local results in a single reduction
+    allreduce_top_results(&top, 1, list, list_length);
+    free_result_heap(&top);
+
+    int selected_count = 0;
+    if (distinct) {
+        selected_count = select_non_overlapping(list, list_length, K, selected, top_count);
+    } else {
+        while (selected_count < list_length && list[selected_count].row != -1) {
+            selected[selected_count] = list[selected_count];
+            selected_count++;
+        }
+    }
+    if (checkpoint != NULL)
+        remove_checkpoints(checkpoint);
+    free(list);
+    return selected_count;
+}
+
+// Function to search every shape of a batch in one pass over the matrix
+// and combine all of them in one reduction. Leaves the best top_count
+// windows of shapes[q] in lists + q * top_count on every rank, padded with
+// row -1 entries. Must be called on every rank.
+void search_batch_windows(SearchContext *ctx, const WindowShape *shapes, int count,
+                          int top_count, SubmatrixResult *lists) {
+    BatchSearch batch = {shapes, count, NULL};
+    batch.tops = (ResultHeap *)malloc(count * sizeof(ResultHeap));
+    if (batch.tops == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (int q = 0; q < count; q++)
+        batch.tops[q] = create_result_heap(top_count);
+
+    if (ctx->dynamic)
+        dynamic_search_batch(ctx, &batch);
+    else
+        search_pass(ctx, search_block_batch, &batch);
+    allreduce_top_results(batch.tops, count, lists, top_count);
+
+    for (int q = 0; q < count; q++)
+        free_result_heap(&batch.tops[q]);
+    free(batch.tops);
+}
+
+// Function to find which shape of the given area has the best window in
+// a batch's result lists, returns its index or -1 if none has one
+int best_shape_of_area(const WindowShape *shapes, int count, const SubmatrixResult *lists,
+                       int top_count, int area) {
+    int best = -1;
+    for (int q = 0; q < count; q++) {
+        if ((long long)shapes[q].rows * shapes[q].cols != area) continue;
+        const SubmatrixResult *list = lists + (size_t)q * top_count;
+        if (list[0].row != -1 &&
+            (best < 0 || list[0].max_log_product > lists[(size_t)best * top_count].max_log_product))
+            best = q;
+    }
+    return best;
+}
+
+// Function to read the next server command on rank 0. A query is a
+// window size K or PxQ optionally followed by the number of results R and
+// sets query to {rows, cols, R}. An update is "set i j v [i j v ...]" and
+// sets query to {-1, count, 0} with the triples in *changes. Returns 0 at
+// end of input or on quit. Malformed commands are reported and skipped.
+int read_query(const SearchContext *ctx, int query[3], int **changes) {
+    static char line[65536];
+    char word[128];
+    int max_rows = ctx->halo_rows + 1, max_cols = ctx->halo_cols + 1;
+
+    int prompt = 1;
+    for (;;) {
+        if (prompt) {
+            printf("> ");
+            fflush(stdout);
+        }
+        if (fgets(line, sizeof(line), stdin) == NULL) return 0;
+
+        // Blank lines (including the rest of the line the parameters
+        // were read from) are skipped without a new prompt
+        int count = 1, consumed = 0;
+        int fields = sscanf(line, "%127s %n", word, &consumed);
+        prompt = (fields > 0);
+        if (fields <= 0) continue;
+        if (strcmp(word, "quit") == 0 || strcmp(word, "exit") == 0) return 0;
+
+        if (strcmp(word, "set") == 0) {
+            int capacity = 16, used = 0, ok = 1;
+            *changes = (int *)malloc(capacity * 3 * sizeof(int));
+            char *cursor = line + consumed, *end;
+            for (;;) {
+                long cell[3];
+                int k;
+                for (k = 0; k < 3; k++) {
+                    cell[k] = strtol(cursor, &end, 10);
+                    if (end == cursor) break;
+                    cursor = end;
+                }
+                if (k == 0) break;
+                if (k < 3 || cell[0] < 0 || cell[0] >= ctx->N || cell[1] < 0 || cell[1] >= ctx->M ||
+                    cell[2] < ELEMENT_MIN || cell[2] > ELEMENT_MAX) {
+                    ok = 0;
+                    break;
+                }
+                if (used == capacity) {
+                    capacity *= 2;
+                    *changes = (int *)realloc(*changes, capacity * 3 * sizeof(int));
+                }
+                if (*changes == NULL) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    exit(1);
+                }
+                for (k = 0; k < 3; k++)
+                    (*changes)[used * 3 + k] = (int)cell[k];
+                used++;
+            }
+            while (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r')
+                cursor++;
+            if (ok && used > 0 && *cursor == '\0') {
+                query[0] = -1;
+                query[1] = used;
+                query[2] = 0;
+                return 1;
+            }
+            printf("Error: Expected 'set i j v [i j v ...]' with cells inside the %dx%d matrix"
+                   " and values in %d..%d\n", ctx->N, ctx->M, ELEMENT_MIN, ELEMENT_MAX);
+            free(*changes);
+            *changes = NULL;
+            continue;
+        }
+
+        WindowShape *shape = NULL;
+        int parsed = parse_window_shapes(word, &shape);
+        fields = sscanf(line + consumed, "%d", &count);
+        if (parsed != 1 || count <= 0) {
+            printf("Error: Expected a query like '8', '8 5', '4x16 3' or 'set i j v'\n");
+        } else if (shape->rows > max_rows || shape->cols > max_cols) {
+            printf("Error: Window %dx%d exceeds the largest resident window %dx%d\n",
+                   shape->rows, shape->cols, max_rows, max_cols);
+        } else {
+            query[0] = shape->rows;
+            query[1] = shape->cols;
+            query[2] = count;
+            free(shape);
+            return 1;
+        }
+        free(shape);
+    }
+}
+
+// Function to answer commands against the resident blocks until rank 0
+// reaches end of input. A query scans only the tiles that changed since
+// the same query last ran, and one reduction combines the ranks; nothing
+// is regenerated or redistributed.
+void serve_queries(const SearchContext *ctx, ResidentSet *set) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    for (;;) {
+        int query[3] = {0, 0, 0};
+        int *changes = NULL;
+        if (rank == 0 && !read_query(ctx, query, &changes))
+            query[0] = 0;
+        MPI_Bcast(query, 3, MPI_INT, 0, MPI_COMM_WORLD);
+        if (query[0] == 0) break;
+
+        double query_start = omp_get_wtime();
+        if (query[0] < 0) {
+            // Apply a batch of cell updates on every rank holding the cells
+            int count = query[1];
+            if (rank != 0)
+                changes = (int *)malloc(count * 3 * sizeof(int));
+            if (changes == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+            MPI_Bcast(changes, count * 3, MPI_INT, 0, MPI_COMM_WORLD);
+            for (int b = 0; b < set->count; b++)
+                for (int k = 0; k < count; k++)
+                    update_resident_block(&set->blocks[b], changes[3 * k],
+                                          changes[3 * k + 1], changes[3 * k + 2]);
+            free(changes);
+            MPI_Barrier(MPI_COMM_WORLD);
+            if (rank == 0)
+                printf("Updated %d cells in %.6f seconds\n", count, omp_get_wtime() - query_start);
+            continue;
+        }
+
+        WindowShape shape = {query[0], query[1]};
+        int count = query[2];
+        ResultHeap top = create_result_heap(count);
+        SubmatrixResult *list = (SubmatrixResult *)malloc(count * sizeof(SubmatrixResult));
+        if (list == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+
+        for (int b = 0; b < set->count; b++)
+            query_resident_block(&set->blocks[b], shape, count, &top);
+        allreduce_top_results(&top, 1, list, count);
+
+        if (rank == 0) {
+            if (list[0].row == -1) {
+                printf("Window %dx%d: no valid submatrix found with odd elements\n",
+                       shape.rows, shape.cols);
+            } else {
+                printf("Window %dx%d: best at (%d, %d), log sum %.6f\n", shape.rows,
+                       shape.cols, list[0].row, list[0].col, list[0].max_log_product);
+                for (int k = 0; count > 1 && k < count && list[k].row != -1; k++)
+                    printf("%4d. (%d, %d) log sum %.6f\n", k + 1, list[k].row,
+                           list[k].col, list[k].max_log_product);
+            }
+            printf("Query time: %.6f seconds\n", omp_get_wtime() - query_start);
+        }
+        free_result_heap(&top);
+        free(list);
+    }
+    if (rank == 0)
+        printf("\n");
+}
+
+// Structure to hold a benchmark sweep. Every list is swept in full; the
+// number of ranks is fixed per run, so rank sweeps run the program once
+// per world size (see the makefile's bench target).
+typedef struct {
+    WindowShape *sizes;     // Matrix sizes, N x M
+    int size_count;
+    int *ks;
+    int k_count;
+    int *threads;
+    int thread_count;
+    int *engines;
+    int engine_count;
+    int warmup;
+    int trials;
+    int json;
+} BenchConfig;
+
+// Structure to hold a copy of one rank's block for repeated benchmark runs
+typedef struct {
+    Matrix data;
+    RankBlock owned;
+    int row_offset;
+} KeptBlock;
+
+// Structure to hold every block a rank keeps for the benchmark
+typedef struct {
+    KeptBlock *blocks;
+    int count, capacity;
+} KeptBlocks;
+
+// Block visitor keeping a copy of the block
+void keep_block_copy(const Matrix *block, const RankBlock *owned, int row_offset, void *arg) {
+    KeptBlocks *kept = (KeptBlocks *)arg;
+    if (kept->count == kept->capacity) {
+        kept->capacity = (kept->capacity > 0) ? kept->capacity * 2 : 4;
+        kept->blocks = (KeptBlock *)realloc(kept->blocks, kept->capacity * sizeof(KeptBlock));
+        if (kept->blocks == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    KeptBlock *copy = &kept->blocks[kept->count++];
+    copy->data = allocate_matrix(block->rows, block->cols);
+    for (int i = 0; i < block->rows; i++)
+        memcpy(matrix_row(&copy->data, i), matrix_row(block, i), block->cols * sizeof(MatrixElement));
+    copy->owned = *owned;
+    copy->row_offset = row_offset;
+}
+
+// Function to parse a comma separated list of positive integers, returns
+// the number of values stored in *values or -1 if the list is malformed
+int parse_int_list(const char *text, int **values) {
+    int count = 1;
+    for (const char *c = text; *c != '\0'; c++)
+        if (*c == ',') count++;
+
+    *values = (int *)malloc(count * sizeof(int));
+    if (*values == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    const char *cursor = text;
+    for (int k = 0; k < count; k++) {
+        char *end;
+        long value = strtol(cursor, &end, 10);
+        if (end == cursor || value <= 0 || value > INT_MAX) return -1;
+        if (*end != (k + 1 < count ? ',' : '\0')) return -1;
+        (*values)[k] = (int)value;
+        cursor = end + 1;
+    }
+    return count;
+}
+
+// Function to parse a whole decimal integer in [min, max] into *value,
+// returns 0 if text is not one
+int parse_int_option(const char *text, long min, long max, int *value) {
+    char *end;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < min || parsed > max) return 0;
+    *value = (int)parsed;
+    return 1;
+}
+
+// Function to check whether a command line option is followed by a value
+int option_takes_value(const char *name) {
+    static const char *options[] = {
+        "--engine", "--size", "--window", "--tile", "--format", "--input", "--save",
+        "--checkpoint", "--checkpoint-every", "--report", "--top", "--seed", "--max-window",
+        "--sizes", "--ks", "--threads", "--engines", "--warmup", "--trials", "--area", "--batch"
+    };
+    for (size_t k = 0; k < sizeof(options) / sizeof(options[0]); k++)
+        if (strcmp(name, options[k]) == 0) return 1;
+    return 0;
+}
+
+// Function to compare doubles for qsort
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Function to time one search of every kept block for K, returning the
+// wall time on rank 0 (the reduction synchronizes all ranks)
+double time_bench_search(SearchEngine engine, const KeptBlocks *kept, int K,
+                         SubmatrixResult *best) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = omp_get_wtime();
+
+    ResultHeap top = create_result_heap(1);
+    for (int b = 0; b < kept->count; b++) {
+        const KeptBlock *block = &kept->blocks[b];
+        int rows = block->owned.window_rows + K - 1;
+        int cols = block->owned.window_cols + K - 1;
+        if (rows > block->data.rows) rows = block->data.rows;
+        if (cols > block->data.cols) cols = block->data.cols;
+        if (rows < K || cols < K) continue;
+
+        // The view holds exactly the windows this block owns for K
+        Matrix view = matrix_view(&block->data, 0, 0, rows, cols);
+        ResultHeap block_top = create_result_heap(1);
+        find_top_submatrices(engine, &view, K, &block_top);
+        push_block_results(&top, &block_top, &block->owned, block->row_offset);
+        free_result_heap(&block_top);
+    }
+    allreduce_top_results(&top, 1, best, 1);
+    free_result_heap(&top);
+
+    return omp_get_wtime() - start;
+}
+
+// Function to run a benchmark sweep and print one CSV row or JSON line per
+// (size, K, engine, threads) with the median and p95 of the timed trials.
+// windows_per_s counts every K x K window of the matrix and gb_per_s the
+// matrix bytes, both over the median time.
+void run_benchmarks(const BenchConfig *config) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    double *times = (double *)malloc(config->trials * sizeof(double));
+    if (times == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    if (rank == 0 && !config->json)
+        printf("engine,N,M,K,ranks,threads,simd,trials,median_s,p95_s,min_s,"
+               "windows_per_s,gb_per_s,best_row,best_col,best_score\n");
+
+    for (int s = 0; s < config->size_count; s++) {
+        int N = config->sizes[s].rows, M = config->sizes[s].cols;
+        int max_k = 0;
+        for (int k = 0; k < config->k_count; k++)
+            if (config->ks[k] <= N && config->ks[k] <= M && config->ks[k] > max_k)
+                max_k = config->ks[k];
+        if (max_k == 0) continue;
+
+        // Generate every rank's block once, with the halo of the largest K
+        SearchContext ctx;
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.N = N;
+        ctx.M = M;
+        ctx.shape_rows = ctx.shape_cols = 1;
+        ctx.halo_rows = ctx.halo_cols = max_k - 1;
+        ctx.band_rows = N;
+        create_process_grid(size, N, M, ctx.dims);
+        KeptBlocks kept = {NULL, 0, 0};
+        search_pass(&ctx, keep_block_copy, &kept);
+
+        for (int k = 0; k < config->k_count; k++) {
+            int K = config->ks[k];
+            if (K > N || K > M) continue;
+            double windows = (double)(N - K + 1) * (M - K + 1);
+            double bytes = (double)N * M * sizeof(MatrixElement);
+
+            for (int e = 0; e < config->engine_count; e++) {
+                for (int t = 0; t < config->thread_count; t++) {
+                    SearchEngine engine = (SearchEngine)config->engines[e];
+                    SubmatrixResult best;
+                    omp_set_num_threads(config->threads[t]);
+
+                    for (int w = 0; w < config->warmup; w++)
+                        time_bench_search(engine, &kept, K, &best);
+                    for (int r = 0; r < config->trials; r++)
+                        times[r] = time_bench_search(engine, &kept, K, &best);
+                    if (rank != 0) continue;
+
+                    qsort(times, config->trials, sizeof(double), compare_doubles);
+                    double median = (config->trials % 2) ? times[config->trials / 2]
+                                  : 0.5 * (times[config->trials / 2 - 1] + times[config->trials / 2]);
+                    int p95_index = (int)ceil(0.95 * config->trials) - 1;
+                    double p95 = times[p95_index < 0 ? 0 : p95_index];
+
+                    if (config->json)
+                        printf("{\"engine\": \"%s\", \"N\": %d, \"M\": %d, \"K\": %d, \"ranks\": %d, "
+                               "\"threads\": %d, \"simd\": \"%s\", \"trials\": %d, \"median_s\": %.9f, "
+                               "\"p95_s\": %.9f, \"min_s\": %.9f, \"windows_per_s\": %.6e, "
+                               "\"gb_per_s\": %.6f, \"best_row\": %d, \"best_col\": %d, "
+                               "\"best_score\": %.6f}\n",
+                               engine_name(engine), N, M, K, size, config->threads[t],
+                               get_simd_kernels()->name, config->trials, median, p95, times[0],
+                               windows / median, bytes / median / 1e9, best.row, best.col,
+                               best.max_log_product);
+                    else
+                        printf("%s,%d,%d,%d,%d,%d,%s,%d,%.9f,%.9f,%.9f,%.6e,%.6f,%d,%d,%.6f\n",
+                               engine_name(engine), N, M, K, size, config->threads[t],
+                               get_simd_kernels()->name, config->trials, median, p95, times[0],
+                               windows / median, bytes / median / 1e9, best.row, best.col,
+                               best.max_log_product);
+                    fflush(stdout);
+                }
+            }
+        }
+
+        for (int b = 0; b < kept.count; b++)
+            free_matrix(&kept.blocks[b].data);
+        free(kept.blocks);
+    }
+    free(times);
+}
+
+// Function to write a phase and thread report of the run as JSON. Must be
+// called on every rank; rank 0 gathers the counters and writes the file
+// and returns 0 if it could not.
+// The top-level phases are the slowest rank's, since that rank is the
+// one every collective waits for.
+int write_report(const char *path, const SearchContext *ctx, const char *mode,
+                 const char *engine, int K) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    phase_switch(current_phase);
+
+    double *all_phases = NULL, *all_counters = NULL;
+    int *thread_counts = NULL, *counter_displs = NULL, *counter_counts = NULL;
+    double *local_counters = (double *)malloc((size_t)(report_threads > 0 ? report_threads : 1) *
+                                              4 * sizeof(double));
+    if (local_counters == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (int t = 0; t < report_threads; t++) {
+        local_counters[4 * t] = thread_counters[t].windows;
+        local_counters[4 * t + 1] = thread_counters[t].busy;
+        local_counters[4 * t + 2] = thread_counters[t].merge;
+        local_counters[4 * t + 3] = thread_counters[t].idle;
+    }
+
+    if (rank == 0) {
+        all_phases = (double *)malloc((size_t)size * PHASE_COUNT * sizeof(double));
+        thread_counts = (int *)malloc(size * sizeof(int));
+        counter_counts = (int *)malloc(size * sizeof(int));
+        counter_displs = (int *)malloc(size * sizeof(int));
+        if (all_phases == NULL || thread_counts == NULL || counter_counts == NULL ||
+            counter_displs == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    MPI_Gather(phase_seconds, PHASE_COUNT, MPI_DOUBLE, all_phases, PHASE_COUNT, MPI_DOUBLE,
+               0, MPI_COMM_WORLD);
+    MPI_Gather(&report_threads, 1, MPI_INT, thread_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        int total = 0;
+        for (int r = 0; r < size; r++) {
+            counter_counts[r] = 4 * thread_counts[r];
+            counter_displs[r] = total;
+            total += counter_counts[r];
+        }
+        all_counters = (double *)malloc((size_t)(total > 0 ? total : 1) * sizeof(double));
+        if (all_counters == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    MPI_Gatherv(local_counters, 4 * report_threads, MPI_DOUBLE, all_counters, counter_counts,
+                counter_displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    free(local_counters);
+
+    int ok = 1;
+    if (rank == 0) {
+        FILE *file = fopen(path, "w");
+        if (file == NULL) {
+            printf("Error: Cannot write report '%s'\n", path);
+            ok = 0;
+        } else {
+            fprintf(file, "{\n  \"mode\": \"%s\", \"engine\": \"%s\", \"N\": %d, \"M\": %d, \"K\": %d,\n",
+                    mode, engine, ctx->N, ctx->M, K);
+            fprintf(file, "  \"ranks\": %d, \"grid\": [%d, %d], \"threads\": %d, \"simd\": \"%s\",\n",
+                    size, ctx->dims[0], ctx->dims[1], omp_get_max_threads(),
+                    get_simd_kernels()->name);
+
+            // Slowest rank per phase
+            fprintf(file, "  \"phases_s\": {");
+            for (int p = 0; p < PHASE_COUNT; p++) {
+                double slowest = 0.0;
+                for (int r = 0; r < size; r++)
+                    if (all_phases[(size_t)r * PHASE_COUNT + p] > slowest)
+                        slowest = all_phases[(size_t)r * PHASE_COUNT + p];
+                fprintf(file, "%s\"%s\": %.9f", p > 0 ? ", " : "", phase_names[p], slowest);
+            }
+            fprintf(file, "},\n  \"per_rank\": [\n");
+
+            for (int r = 0; r < size; r++) {
+                fprintf(file, "    {\"rank\": %d, \"phases_s\": {", r);
+                for (int p = 0; p < PHASE_COUNT; p++)
+                    fprintf(file, "%s\"%s\": %.9f", p > 0 ? ", " : "", phase_names[p],
+                            all_phases[(size_t)r * PHASE_COUNT + p]);
+                fprintf(file, "},\n     \"threads\": [");
+                for (int t = 0; t < thread_counts[r]; t++) {
+                    const double *c = all_counters + counter_displs[r] + 4 * t;
+                    fprintf(file, "%s\n       {\"thread\": %d, \"windows\": %.0f, \"busy_s\": %.9f, "
+                            "\"merge_s\": %.9f, \"idle_s\": %.9f}",
+                            t > 0 ? "," : "", t, c[0], c[1], c[2], c[3]);
+                }
+                fprintf(file, "%s]}%s\n", thread_counts[r] > 0 ? "\n     " : "",
+                        r + 1 < size ? "," : "");
+            }
+            fprintf(file, "  ]\n}\n");
+            fclose(file);
+        }
+        free(all_phases);
+        free(thread_counts);
+        free(counter_counts);
+        free(counter_displs);
+        free(all_counters);
+    }
+    return ok;
+}
+
+// Distributions every verification case is searched with
+typedef enum {
+    VERIFY_LOCAL,           // Every rank generates its own block
+    VERIFY_SCATTER,         // Rank 0 scatters bands
+    VERIFY_PIPELINE,        // Rank 0 scatters bands with non-blocking transfers
+    VERIFY_DYNAMIC,         // Tiles of the generated matrix from the shared queue
+    VERIFY_FILE,            // Every rank maps its own block of a file
+    VERIFY_FILE_DYNAMIC,    // Tiles of the file from the shared queue
+    VERIFY_MODE_COUNT
+} VerifyMode;
+
+static const char *verify_mode_names[VERIFY_MODE_COUNT] = {
+    "local", "scatter", "pipeline", "dynamic", "file", "file+dynamic"
+};
+
+// Structure to hold one randomized verification case
+typedef struct {
+    int N, M, K;
+    int top_count;
+    int distinct;
+    int odd_keep;       // 1 keeps the generated matrix, 0 makes every value
+                        // even, n > 1 keeps about one odd value in n
+    int band_rows;      // Band height of the generated and scattered runs
+    uint64_t seed;      // Generator seed of the matrix
+    WindowShape *shapes;    // Batch: K x K and every shape of a random area
+    int shape_count;
+} VerifyCase;
+
+// Function to draw a uniform integer in [low, high] from a SplitMix64 state
+static int verify_draw(uint64_t *state, int low, int high) {
+    *state = splitmix64(*state);
+    return low + (int)(*state % (uint64_t)(high - low + 1));
+}
+
+// Function to make verification case index from the base seed. The first
+// cases are the edge cases: a single element, one row, one column, K = N,
+// non-square with K = min(N, M), no odd values, sparse odd values and a
+// matrix wider than a prefix column block; the rest are random. The batch
+// of every case is K x K plus every shape of a random area.
+VerifyCase make_verify_case(int index, uint64_t base_seed) {
+    VerifyCase c;
+    uint64_t state = splitmix64(base_seed ^ splitmix64((uint64_t)index));
+    c.seed = state;
+    c.N = verify_draw(&state, 1, VERIFY_MAX_SIZE);
+    c.M = verify_draw(&state, 1, VERIFY_MAX_SIZE);
+    c.odd_keep = 1;
+    switch (index) {
+        case 0: c.N = c.M = 1; break;
+        case 1: c.N = 1; break;
+        case 2: c.M = 1; break;
+        case 3: c.M = c.N; break;
+        case 4: if (c.M == c.N) c.M = (c.N > 1) ? c.N - 1 : 2; break;
+        case 5: c.odd_keep = 0; break;
+        case 6: c.odd_keep = 64; break;
+        case 7:
+            c.M = verify_draw(&state, PREFIX_COLUMN_BLOCK + 1, PREFIX_COLUMN_BLOCK + 64);
+            break;
+    }
+
+    int smaller = (c.N < c.M) ? c.N : c.M;
+    c.K = verify_draw(&state, 1, (index == 7 && smaller > 12) ? 12 : smaller);
+    if (index == 3 || index == 4) c.K = smaller;
+    c.top_count = verify_draw(&state, 1, 8);
+    c.distinct = verify_draw(&state, 0, 1);
+    c.band_rows = verify_draw(&state, 1, c.N - c.K + 1);
+
+    int area = verify_draw(&state, 1, c.N) * verify_draw(&state, 1, c.M);
+    c.shapes = (WindowShape *)malloc(sizeof(WindowShape));
+    if (c.shapes == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    c.shapes[0].rows = c.shapes[0].cols = c.K;
+    c.shape_count = 1;
+    add_area_shapes(area, c.N, c.M, &c.shapes, &c.shape_count);
+    return c;
+}
+
+// Function to fill matrix with case c's values
+void fill_verify_matrix(const VerifyCase *c, Matrix *matrix) {
+    uint64_t saved_seed = generator_seed;
+    generator_seed = c->seed;
+    generate_random_matrix(matrix);
+    generator_seed = saved_seed;
+    if (c->odd_keep == 1) return;
+
+    for (int i = 0; i < matrix->rows; i++) {
+        MatrixElement *row = matrix_row(matrix, i);
+        for (int j = 0; j < matrix->cols; j++) {
+            uint64_t z = splitmix64(c->seed + (uint64_t)i * matrix->cols + j);
+            if (is_odd(row[j]) && (c->odd_keep == 0 || z % (uint64_t)c->odd_keep != 0))
+                row[j] = (MatrixElement)(row[j] > 0 ? row[j] - 1 : row[j] + 1);
+        }
+    }
+}
+
+// Function to find the best top_count rows x cols windows (mutually non-
+// overlapping with distinct, square windows only) with a serial scan of
+// calculate_log_product_window, returns how many were found. Every window
+// with an odd element is left in *all, sorted best first.
+int verify_reference(const Matrix *matrix, int rows, int cols, int top_count, int distinct,
+                     SubmatrixResult *expected, ResultHeap *all) {
+    *all = create_result_heap((matrix->rows - rows + 1) * (matrix->cols - cols + 1));
+    for (int i = 0; is_valid_window(i, 0, rows, cols, matrix->rows, matrix->cols); i++) {
+        for (int j = 0; is_valid_window(i, j, rows, cols, matrix->rows, matrix->cols); j++) {
+            SubmatrixResult window = {i, j, calculate_log_product_window(matrix, i, j, rows, cols)};
+            if (window.max_log_product != -INFINITY)
+                result_heap_push(all, window);
+        }
+    }
+    result_heap_sort(all);
+
+    int count;
+    if (distinct) {
+        count = select_non_overlapping(all->items, all->count, rows, expected, top_count);
+    } else {
+        count = (all->count < top_count) ? all->count : top_count;
+        memcpy(expected, all->items, count * sizeof(SubmatrixResult));
+    }
+    return count;
+}
+
+// Function to check if two floating-point scores agree within rounding
+static int verify_scores_close(double found, double expected) {
+    return fabs(found - expected) <= 1e-9 * (1.0 + fabs(expected));
+}
+
+// Function to check if window may be picked after the first count picks:
+// it is not one of them and, with distinct, overlaps none of them
+static int verify_pick_allowed(SubmatrixResult window, const SubmatrixResult *picks, int count,
+                               int K, int distinct) {
+    for (int k = 0; k < count; k++) {
+        if (distinct ? windows_overlap(window, picks[k], K)
+                     : window.row == picks[k].row && window.col == picks[k].col)
+            return 0;
+    }
+    return 1;
+}
+
+// Function to check a search's results against the reference's, with all
+// every window of the matrix sorted best first. Fixed-point scores must
+// match expected exactly, positions included. Floating-point engines round
+// differently, so each found window is replayed through the reference's
+// picks instead: it must be an allowed window, its score must match the
+// reference's score for its position, and that score must tie, within
+// rounding, with the best allowed window's. So positions must match the
+// reference's total order wherever scores are not tied within rounding,
+// for every result and every later pick of distinct.
+int verify_results_match(const ResultHeap *all, int K, int top_count, int distinct,
+                         const SubmatrixResult *expected, int expected_count,
+                         const SubmatrixResult *found, int found_count, int exact) {
+    if (exact) {
+        if (found_count != expected_count) return 0;
+        for (int k = 0; k < found_count; k++)
+            if (found[k].row != expected[k].row || found[k].col != expected[k].col ||
+                found[k].max_log_product != expected[k].max_log_product)
+                return 0;
+        return 1;
+    }
+
+    if (found_count > top_count) return 0;
+    for (int k = 0; k <= found_count; k++) {
+        int first = 0;
+        while (first < all->count && !verify_pick_allowed(all->items[first], found, k, K, distinct))
+            first++;
+        // Fewer picks than wanted only once no allowed window is left
+        if (k == found_count) return k == top_count || first == all->count;
+        if (first == all->count) return 0;
+
+        int match = 0;
+        double best = all->items[first].max_log_product;
+        for (int w = first; w < all->count && !match; w++) {
+            SubmatrixResult window = all->items[w];
+            if (!verify_scores_close(window.max_log_product, best)) break;
+            match = window.row == found[k].row && window.col == found[k].col &&
+                    verify_pick_allowed(window, found, k, K, distinct) &&
+                    verify_scores_close(found[k].max_log_product, window.max_log_product);
+        }
+        if (!match) return 0;
+    }
+    return 1;
+}
+
+// Function to print the expected and found results of a failed check
+void print_verify_lists(const SubmatrixResult *expected, int expected_count,
+                        const SubmatrixResult *found, int found_count) {
+    for (int k = 0; k < expected_count || k < found_count; k++) {
+        printf("  %d. expected ", k + 1);
+        if (k < expected_count)
+            printf("(%d, %d) %.17g", expected[k].row, expected[k].col, expected[k].max_log_product);
+        else
+            printf("nothing");
+        printf(", got ");
+        if (k < found_count)
+            printf("(%d, %d) %.17g\n", found[k].row, found[k].col, found[k].max_log_product);
+        else
+            printf("nothing\n");
+    }
+}
+
+// Function to set up a search of case c in the given mode for windows
+// from shape_rows x shape_cols up to halo_rows + 1 x halo_cols + 1. Rank 0
+// scatters from full; the file modes map path.
+void setup_verify_context(SearchContext *ctx, const VerifyCase *c, VerifyMode mode,
+                          int shape_rows, int shape_cols, int halo_rows, int halo_cols,
+                          const Matrix *full, const char *path) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    int from_file = mode == VERIFY_FILE || mode == VERIFY_FILE_DYNAMIC;
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->N = c->N;
+    ctx->M = c->M;
+    ctx->shape_rows = shape_rows;
+    ctx->shape_cols = shape_cols;
+    ctx->halo_rows = halo_rows;
+    ctx->halo_cols = halo_cols;
+    ctx->band_rows = c->N - shape_rows + 1;
+    if (!from_file && c->band_rows < ctx->band_rows)
+        ctx->band_rows = c->band_rows;
+    ctx->scatter = mode == VERIFY_SCATTER || mode == VERIFY_PIPELINE;
+    ctx->pipeline = mode == VERIFY_PIPELINE;
+    ctx->dynamic = mode == VERIFY_DYNAMIC || mode == VERIFY_FILE_DYNAMIC;
+    if (from_file) {
+        ctx->input_path = path;
+        if (!read_matrix_header(path, &ctx->header))
+            MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (ctx->scatter && rank == 0) {
+        ctx->source = open_matrix_source(full);
+        ctx->matrix = allocate_matrix(first_band_height(ctx), c->M);
+        ctx->source.read_rows(&ctx->source, &ctx->matrix, 0, first_band_height(ctx));
+    }
+    create_process_grid(size, ctx->scatter ? first_band_height(ctx) : c->N, c->M, ctx->dims);
+}
+
+// Function to write a checkpoint of a best-window search of ctx on every
+// rank, claiming the first bands bands done with a marker result whose
+// score no window can reach, hashed from the matrix file as it is now
+void plant_verify_checkpoint(Checkpoint *checkpoint, const SearchContext *ctx, int K, int bands) {
+    CheckpointHeader params = checkpoint_params(ctx, K);
+    params.capacity = 1;
+    ResultHeap top = create_result_heap(1);
+    SubmatrixResult marker = {0, 0, 1e6};
+    result_heap_push(&top, marker);
+
+    checkpoint->sequence = 0;
+    checkpoint->bands_done = bands;
+    checkpoint->data_hash = hash_file_bands(ctx, bands);
+    write_checkpoint(checkpoint, &params, &top);
+    finish_checkpoint(checkpoint);
+    free_result_heap(&top);
+}
+
+// Function to check that a search of a matrix file resumes from a
+// checkpoint of the same file, and that a rank rejects its checkpoint once
+// a row only the halo of its bands read has changed. The file is searched
+// in bands, so the matrix's bottom K - 1 rows are read by the last band
+// of the bottom ranks but start no window. Must be called on every rank;
+// returns the number of failed checks (on rank 0) and adds to *checks.
+int verify_checkpoint_resume(const char *path, uint64_t seed, int *checks) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    VerifyCase c;
+    memset(&c, 0, sizeof(c));
+    c.N = 40;
+    c.M = 30;
+    c.K = 4;
+    c.odd_keep = 1;
+    c.seed = seed;
+
+    Matrix full = {NULL, 0, 0, 0};
+    int ok = 1;
+    if (rank == 0) {
+        full = allocate_matrix(c.N, c.M);
+        fill_verify_matrix(&c, &full);
+        RowSource source = open_matrix_source(&full);
+        ok = write_matrix_file(path, &source);
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok) {
+        free_matrix(&full);
+        return 0;
+    }
+
+    SearchContext ctx;
+    setup_verify_context(&ctx, &c, VERIFY_FILE, c.K, c.K, c.K - 1, c.K - 1, &full, path);
+    ctx.band_rows = 5;
+    char name[64];
+    snprintf(name, sizeof(name), "%s.checkpoint", path);
+    Checkpoint checkpoint = {name, 0.0, 0.0, 0, 0, 0, 0, 0, MPI_FILE_NULL, MPI_REQUEST_NULL, NULL};
+    SubmatrixResult found;
+
+    // Ranks whose block reads the bottom rows
+    RankBlock block = get_rank_block(rank, ctx.dims, c.N - c.K + 1, c.M - c.K + 1);
+    int local_rows, local_cols;
+    get_block_extent(&block, c.N, c.M, c.K - 1, c.K - 1, &local_rows, &local_cols);
+    int reads_bottom = local_rows > 0 && local_cols > 0 && block.first_row + local_rows == c.N;
+
+    int failures = 0, resumed_everywhere, rejected_where_changed;
+    plant_verify_checkpoint(&checkpoint, &ctx, c.K, c.N);
+    search_top_windows(&ctx, ENGINE_PREFIX, c.K, 1, 0, &found, &checkpoint);
+    MPI_Reduce(&checkpoint.resumed, &resumed_everywhere, 1, MPI_INT, MPI_MIN, 0, MPI_COMM_WORLD);
+
+    // Every halo-only row becomes 99s, so the best window changes
+    plant_verify_checkpoint(&checkpoint, &ctx, c.K, c.N);
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (rank == 0) {
+        for (int i = c.N - c.K + 1; i < c.N; i++)
+            for (int j = 0; j < c.M; j++)
+                matrix_row(&full, i)[j] = 99;
+        RowSource source = open_matrix_source(&full);
+        ok = write_matrix_file(path, &source);
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    search_top_windows(&ctx, ENGINE_PREFIX, c.K, 1, 0, &found, &checkpoint);
+    int as_expected = checkpoint.resumed == !reads_bottom;
+    MPI_Reduce(&as_expected, &rejected_where_changed, 1, MPI_INT, MPI_MIN, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        *checks += 2;
+        if (!resumed_everywhere) {
+            failures++;
+            printf("FAIL checkpoint resume: a rank did not resume from a checkpoint of an "
+                   "unchanged file\n");
+        }
+        if (!ok || !rejected_where_changed) {
+            failures++;
+            printf("FAIL checkpoint resume: a changed halo row did not reject exactly the "
+                   "checkpoints of the ranks reading it\n");
+        }
+        printf("Checkpoint resume: 2 checks, %s\n", failures ? "FAILED" : "ok");
+        free_matrix(&full);
+    }
+    free(checkpoint.buffer);
+    return failures;
+}
+
+// Function to run case_count randomized cases through every engine,
+// distribution, thread count and scoring mode and compare every result
+// with the serial reference scan on rank 0. Must be called on every rank;
+// returns the number of failed checks (on rank 0), or -1 if the
+// verification file could not be created.
+int run_verification(int case_count, uint64_t base_seed) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // Cases are also searched from a file in the working directory, which
+    // the ranks of a multi-host run most likely share
+    char path[32] = "hw2_verify_XXXXXX";
+    int ok = 1;
+    if (rank == 0) {
+        int fd = mkstemp(path);
+        ok = fd >= 0;
+        if (ok) close(fd);
+        else printf("Error: Cannot create a verification file in the working directory\n");
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok) return -1;
+    MPI_Bcast(path, sizeof(path), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    int thread_options[3] = {1, 3, omp_get_max_threads()};
+    int thread_option_count = (thread_options[2] == 1 || thread_options[2] == 3) ? 2 : 3;
+    int saved_scores = fixed_point_scores;
+    uint64_t saved_seed = generator_seed;
+    int checks = 0, failures = 0;
+    SubmatrixResult expected[8], found[8];
+
+    if (rank == 0)
+        printf("Verifying %d cases on %d ranks against the serial reference scan\n",
+               case_count, size);
+
+    for (int index = 0; index < case_count; index++) {
+        VerifyCase c = make_verify_case(index, base_seed);
+        int case_failures = 0, case_checks = 0;
+        Matrix full = {NULL, 0, 0, 0};
+        if (rank == 0) {
+            full = allocate_matrix(c.N, c.M);
+            fill_verify_matrix(&c, &full);
+            RowSource source = open_matrix_source(&full);
+            ok = write_matrix_file(path, &source);
+        }
+        MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (!ok) {
+            failures = -1;
+            free(c.shapes);
+            break;
+        }
+        generator_seed = c.seed;
+
+        // The batch searches from its smallest shape with the halo of its largest
+        int batch_rows = INT_MAX, batch_cols = INT_MAX, batch_halo_rows = 0, batch_halo_cols = 0;
+        for (int q = 0; q < c.shape_count; q++) {
+            if (c.shapes[q].rows < batch_rows) batch_rows = c.shapes[q].rows;
+            if (c.shapes[q].cols < batch_cols) batch_cols = c.shapes[q].cols;
+            if (c.shapes[q].rows - 1 > batch_halo_rows) batch_halo_rows = c.shapes[q].rows - 1;
+            if (c.shapes[q].cols - 1 > batch_halo_cols) batch_halo_cols = c.shapes[q].cols - 1;
+        }
+        size_t list_bytes = (size_t)c.shape_count * c.top_count * sizeof(SubmatrixResult);
+        SubmatrixResult *batch_expected = (SubmatrixResult *)malloc(list_bytes);
+        int *batch_expected_counts = (int *)malloc(c.shape_count * sizeof(int));
+        SubmatrixResult *batch_found = (SubmatrixResult *)malloc(list_bytes);
+        ResultHeap *batch_all = (ResultHeap *)malloc(c.shape_count * sizeof(ResultHeap));
+        if (batch_expected == NULL || batch_expected_counts == NULL || batch_found == NULL ||
+            batch_all == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+
+        for (int exact = 1; exact >= 0; exact--) {
+            fixed_point_scores = exact;
+            value_tables_ready = 0;
+            init_value_tables();
+            int expected_count = 0;
+            ResultHeap all;
+            if (rank == 0) {
+                expected_count = verify_reference(&full, c.K, c.K, c.top_count, c.distinct, expected,
+                                                  &all);
+                for (int q = 0; q < c.shape_count; q++)
+                    batch_expected_counts[q] =
+                        verify_reference(&full, c.shapes[q].rows, c.shapes[q].cols, c.top_count, 0,
+                                         batch_expected + (size_t)q * c.top_count, &batch_all[q]);
+            }
+
+            for (int mode = 0; mode < VERIFY_MODE_COUNT; mode++) {
+                // Only the file and rank 0's copy hold a modified matrix
+                if (c.odd_keep != 1 && (mode == VERIFY_LOCAL || mode == VERIFY_DYNAMIC))
+                    continue;
+
+                SearchContext ctx, batch_ctx;
+                setup_verify_context(&ctx, &c, (VerifyMode)mode, c.K, c.K, c.K - 1, c.K - 1,
+                                     &full, path);
+                setup_verify_context(&batch_ctx, &c, (VerifyMode)mode, batch_rows, batch_cols,
+                                     batch_halo_rows, batch_halo_cols, &full, path);
+
+                for (int t = 0; t < thread_option_count; t++) {
+                    omp_set_num_threads(thread_options[t]);
+                    for (int engine = ENGINE_NAIVE; engine <= ENGINE_BOUND; engine++) {
+                        int found_count = search_top_windows(&ctx, (SearchEngine)engine, c.K,
+                                                             c.top_count, c.distinct, found, NULL);
+                        if (rank != 0) continue;
+                        case_checks++;
+                        if (verify_results_match(&all, c.K, c.top_count, c.distinct, expected,
+                                                 expected_count, found, found_count, exact))
+                            continue;
+
+                        case_failures++;
+                        printf("FAIL case %d (%dx%d, K=%d, R=%d%s): %s, %s, %d threads, %s scores\n",
+                               index, c.N, c.M, c.K, c.top_count, c.distinct ? ", distinct" : "",
+                               engine_name((SearchEngine)engine), verify_mode_names[mode],
+                               thread_options[t], exact ? "fixed-point" : "floating-point");
+                        print_verify_lists(expected, expected_count, found, found_count);
+                    }
+
+                    // Every shape of the batch in one pass and one reduction
+                    search_batch_windows(&batch_ctx, c.shapes, c.shape_count, c.top_count,
+                                         batch_found);
+                    for (int q = 0; q < c.shape_count && rank == 0; q++) {
+                        const SubmatrixResult *want = batch_expected + (size_t)q * c.top_count;
+                        const SubmatrixResult *got = batch_found + (size_t)q * c.top_count;
+                        int got_count = 0;
+                        while (got_count < c.top_count && got[got_count].row != -1)
+                            got_count++;
+                        case_checks++;
+                        if (verify_results_match(&batch_all[q], c.shapes[q].rows, c.top_count, 0,
+                                                 want, batch_expected_counts[q], got, got_count,
+                                                 exact))
+                            continue;
+
+                        case_failures++;
+                        printf("FAIL case %d (%dx%d, window %dx%d of a batch of %d, R=%d): "
+                               "%s, %d threads, %s scores\n", index, c.N, c.M, c.shapes[q].rows,
+                               c.shapes[q].cols, c.shape_count, c.top_count,
+                               verify_mode_names[mode], thread_options[t],
+                               exact ? "fixed-point" : "floating-point");
+                        print_verify_lists(want, batch_expected_counts[q], got, got_count);
+                    }
+                }
+                if (rank == 0) {
+                    free_matrix(&ctx.matrix);
+                    free_matrix(&batch_ctx.matrix);
+                }
+            }
+            if (rank == 0) {
+                free_result_heap(&all);
+                for (int q = 0; q < c.shape_count; q++)
+                    free_result_heap(&batch_all[q]);
+            }
+        }
+
+        if (rank == 0) {
+            printf("Case %2d: %dx%d K=%d R=%d%s%s, %d batch shapes: %d checks, %s\n", index, c.N,
+                   c.M, c.K, c.top_count, c.distinct ? " distinct" : "",
+                   c.odd_keep == 0 ? " no odd values" : (c.odd_keep > 1 ? " sparse odd values" : ""),
+                   c.shape_count, case_checks, case_failures ? "FAILED" : "ok");
+            fflush(stdout);
+            free_matrix(&full);
+        }
+        free(batch_expected);
+        free(batch_expected_counts);
+        free(batch_found);
+        free(batch_all);
+        free(c.shapes);
+        checks += case_checks;
+        if (failures >= 0) failures += case_failures;
+    }
+
+    fixed_point_scores = saved_scores;
+    value_tables_ready = 0;
+    init_value_tables();
+    if (failures >= 0) {
+        int resume_failures = verify_checkpoint_resume(path, base_seed, &checks);
+        failures += resume_failures;
+    }
+    generator_seed = saved_seed;
+    omp_set_num_threads(thread_options[2]);
+    if (rank == 0) {
+        unlink(path);
+        if (failures >= 0)
+            printf("%d checks, %d failed: %s\n", checks, failures, failures ? "FAIL" : "PASS");
+    }
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    int N = 0, M = 0, K = 0;
+    double start_time = 0.0, end_time = 0.0;
+    int rank, size;
+    int top_count = 1;
+    int distinct = 0;
+    SearchEngine engine = ENGINE_PREFIX;
+    const char *save_path = NULL;
+    const char *report_path = NULL;
+    WindowShape *shapes = NULL;
+    int shape_count = 0;
+    int *areas = NULL;
+    int area_count = 0;
+    int batch_given = 0, window_given = 0;
+    int serve = 0;
+    int max_window = 0;
+    int bench = 0;
+    int text_output = 1;
+    int print_preview = 0;
+    int placement = 0;
+    int verify_cases = 0;
+    Checkpoint checkpoint = {NULL, DEFAULT_CHECKPOINT_SECONDS, 0.0, 0, 0, 0, 0, 0,
+                             MPI_FILE_NULL, MPI_REQUEST_NULL, NULL};
+    const char *bench_sizes = "1000x1000", *bench_ks = "10";
+    const char *bench_threads = NULL, *bench_engines = "naive,prefix,simd";
+    BenchConfig bench_config = {NULL, 0, NULL, 0, NULL, 0, NULL, 0, 1, 5, 0};
+    FileMapping input_mapping = {NULL, 0};
+    SearchContext ctx;
+
+    // Initialize MPI; outside dynamic passes only the initial thread makes
+    // MPI calls
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &mpi_thread_level);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    phase_mark = omp_get_wtime();
+
+    // --tile, or else HW2_TILE=RxC, overrides the naive engine's tile size
+    const char *tile_text = getenv("HW2_TILE");
+
+    memset(&ctx, 0, sizeof(ctx));
+
+    // Arguments: see print_usage. Dimensions and K that are not given on
+    // the command line are read from standard input.
+    for (int a = 1; a < argc; a++) {
+        // Set to what a malformed option value should have been
+        const char *expected = NULL;
+        if (option_takes_value(argv[a]) && a + 1 == argc) {
+            if (rank == 0)
+                printf("Error: Missing value for %s\n", argv[a]);
+            MPI_Finalize();
+            return 1;
+        }
+
+        if (strcmp(argv[a], "--help") == 0) {
+            if (rank == 0)
+                print_usage(argv[0]);
+            MPI_Finalize();
+            return 0;
+        } else if (strcmp(argv[a], "--size") == 0) {
+            WindowShape *size = NULL;
+            a++;
+            if (strchr(argv[a], 'x') == NULL || parse_window_shapes(argv[a], &size) != 1) {
+                if (rank == 0)
+                    printf("Error: Invalid matrix size '%s' (expected NxM)\n", argv[a]);
+                MPI_Finalize();
+                return 1;
+            }
+            N = size->rows;
+            M = size->cols;
+            free(size);
+        } else if (strcmp(argv[a], "--window") == 0) {
+            // A PxQ window that is not square is searched as a batch of one
+            WindowShape *window = NULL;
+            if (window_given || parse_window_shapes(argv[++a], &window) != 1) {
+                if (rank == 0)
+                    printf("Error: --window must be a positive integer K or PxQ, given once\n");
+                MPI_Finalize();
+                return 1;
+            }
+            window_given = 1;
+            if (window->rows == window->cols) {
+                K = window->rows;
+                free(window);
+            } else {
+                free(shapes);
+                shapes = window;
+                shape_count = 1;
+            }
+        } else if (strcmp(argv[a], "--tile") == 0) {
+            tile_text = argv[++a];
+        } else if (strcmp(argv[a], "--format") == 0) {
+            a++;
+            if (strcmp(argv[a], "text") == 0 || strcmp(argv[a], "json") == 0) {
+                text_output = strcmp(argv[a], "text") == 0;
+            } else {
+                if (rank == 0)
+                    printf("Error: Unknown format '%s' (expected text or json)\n", argv[a]);
+                MPI_Finalize();
+                return 1;
+            }
+        } else if (strcmp(argv[a], "--reproducible") == 0) {
+            fixed_point_scores = 1;
+        } else if (strcmp(argv[a], "--print") == 0) {
+            print_preview = 1;
+        } else if (strcmp(argv[a], "--placement") == 0) {
+            placement = 1;
+        } else if (strcmp(argv[a], "--input") == 0) {
+            ctx.input_path = argv[++a];
+        } else if (strcmp(argv[a], "--save") == 0) {
+            save_path = argv[++a];
+        } else if (strcmp(argv[a], "--checkpoint") == 0) {
+            checkpoint.path = argv[++a];
+        } else if (strcmp(argv[a], "--checkpoint-every") == 0) {
+            char *end;
+            checkpoint.interval = strtod(argv[++a], &end);
+            if (end == argv[a] || *end != '\0' || !(checkpoint.interval >= 0.0) ||
+                isinf(checkpoint.interval))
+                expected = "a number of seconds, not negative";
+        } else if (strcmp(argv[a], "--report") == 0) {
+            report_path = argv[++a];
+        } else if (strcmp(argv[a], "--top") == 0) {
+            if (!parse_int_option(argv[++a], 1, INT_MAX, &top_count))
+                expected = "a positive integer";
+        } else if (strcmp(argv[a], "--distinct") == 0) {
+            distinct = 1;
+        } else if (strcmp(argv[a], "--scatter") == 0) {
+            ctx.scatter = 1;
+        } else if (strcmp(argv[a], "--dynamic") == 0) {
+            ctx.dynamic = 1;
+        } else if (strcmp(argv[a], "--pipeline") == 0) {
+            ctx.scatter = 1;
+            ctx.pipeline = 1;
+        } else if (strcmp(argv[a], "--seed") == 0) {
+            char *end;
+            errno = 0;
+            generator_seed = strtoull(argv[++a], &end, 10);
+            if (argv[a][0] < '0' || argv[a][0] > '9' || *end != '\0' || errno == ERANGE)
+                expected = "an unsigned 64-bit integer";
+        } else if (strcmp(argv[a], "--serve") == 0) {
+            serve = 1;
+        } else if (strcmp(argv[a], "--max-window") == 0) {
+            if (!parse_int_option(argv[++a], 1, INT_MAX, &max_window))
+                expected = "a positive integer";
+        } else if (strcmp(argv[a], "--bench") == 0) {
+            bench = 1;
+        } else if (strcmp(argv[a], "--verify") == 0) {
+            verify_cases = DEFAULT_VERIFY_CASES;
+            if (a + 1 < argc && argv[a + 1][0] != '\0' &&
+                strspn(argv[a + 1], "0123456789") == strlen(argv[a + 1]) &&
+                !parse_int_option(argv[++a], 1, INT_MAX, &verify_cases))
+                expected = "a positive number of cases";
+        } else if (strcmp(argv[a], "--sizes") == 0) {
+            bench_sizes = argv[++a];
+        } else if (strcmp(argv[a], "--ks") == 0) {
+            bench_ks = argv[++a];
+        } else if (strcmp(argv[a], "--threads") == 0) {
+            bench_threads = argv[++a];
+        } else if (strcmp(argv[a], "--engines") == 0) {
+            bench_engines = argv[++a];
+        } else if (strcmp(argv[a], "--warmup") == 0) {
+            if (!parse_int_option(argv[++a], 0, INT_MAX, &bench_config.warmup))
+                expected = "a non-negative integer";
+        } else if (strcmp(argv[a], "--trials") == 0) {
+            if (!parse_int_option(argv[++a], 1, INT_MAX, &bench_config.trials))
+                expected = "a positive integer";
+        } else if (strcmp(argv[a], "--json") == 0) {
+            text_output = 0;
+        } else if (strcmp(argv[a], "--area") == 0) {
+            free(areas);
+            area_count = parse_int_list(argv[++a], &areas);
+            if (area_count < 0) {
+                if (rank == 0)
+                    printf("Error: Invalid area list '%s' (expected e.g. 64,100)\n", argv[a]);
+                MPI_Finalize();
+                return 1;
+            }
+        } else if (strcmp(argv[a], "--batch") == 0) {
+            batch_given = 1;
+            free(shapes);
+            shape_count = parse_window_shapes(argv[++a], &shapes);
+            if (shape_count < 0) {
+                if (rank == 0)
+                    printf("Error: Invalid window list '%s' (expected e.g. 4,8,16x32)\n", argv[a]);
+                MPI_Finalize();
+                return 1;
+            }
+        } else {
+            const char *name = argv[a];
+            if (strcmp(name, "--engine") == 0) {
+                name = argv[++a];
+            } else if (name[0] == '-') {
+                if (rank == 0)
+                    printf("Error: Unknown option '%s' (see --help)\n", name);
+                MPI_Finalize();
+                return 1;
+            }
+            int parsed = parse_engine(name);
+            if (parsed < 0) {
+                if (rank == 0)
+                    printf("Error: Unknown engine '%s' (expected naive, prefix, sliding, simd, gpu or bound)\n", name);
+                MPI_Finalize();
+                return 1;
+            }
+            engine = (SearchEngine)parsed;
+        }
+
+        if (expected != NULL) {
+            if (rank == 0)
+                printf("Error: Invalid value '%s' for %s (expected %s)\n", argv[a], argv[a - 1],
+                       expected);
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    if (tile_text != NULL) {
+        WindowShape *tile = NULL;
+        if (parse_window_shapes(tile_text, &tile) != 1) {
+            if (rank == 0)
+                printf("Error: Invalid tile size '%s' (expected T or RxC)\n", tile_text);
+            MPI_Finalize();
+            return 1;
+        }
+        tile_setting.rows = tile->rows;
+        tile_setting.cols = tile->cols;
+        free(tile);
+    }
+    int batch = shape_count > 0 || area_count > 0;
+    if ((batch || serve) && distinct) {
+        if (rank == 0)
+            printf("Error: --distinct cannot be combined with --batch, --area, --serve or\n"
+                   "PxQ windows\n");
+        MPI_Finalize();
+        return 1;
+    }
+    if (batch && engine != ENGINE_PREFIX) {
+        if (rank == 0)
+            printf("Error: --batch, --area and PxQ windows only run the prefix engine\n");
+        MPI_Finalize();
+        return 1;
+    }
+    if (batch && serve) {
+        if (rank == 0)
+            printf("Error: --batch and --area cannot be combined with --serve\n");
+        MPI_Finalize();
+        return 1;
+    }
+    if ((batch_given || area_count > 0 || serve) && window_given) {
+        if (rank == 0)
+            printf("Error: --window cannot be combined with --batch, --area or --serve\n");
+        MPI_Finalize();
+        return 1;
+    }
+    if (ctx.input_path != NULL && N > 0) {
+        if (rank == 0)
+            printf("Error: --size cannot be combined with --input\n");
+        MPI_Finalize();
+        return 1;
+    }
+    if (ctx.dynamic && (serve || ctx.scatter)) {
+        if (rank == 0)
+            printf("Error: --dynamic cannot be combined with --serve, --scatter or --pipeline\n");
+        MPI_Finalize();
+        return 1;
+    }
+    if (checkpoint.path != NULL && (serve || batch || ctx.scatter || ctx.dynamic)) {
+        if (rank == 0)
+            printf("Error: --checkpoint only searches K x K windows without --serve,\n"
+                   "--scatter, --pipeline or --dynamic\n");
+        MPI_Finalize();
+        return 1;
+    }
+    if (serve && !text_output) {
+        if (rank == 0)
+            printf("Error: --serve only supports text output\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    init_value_tables();
+
+    // Ranks sharing a host split its cores unless told otherwise
+    if (bench_threads == NULL)
+        share_node_cores();
+
+    // Run a benchmark sweep instead of a single search
+    if (bench) {
+        char default_threads[16];
+        bench_config.json = !text_output;
+        snprintf(default_threads, sizeof(default_threads), "%d", omp_get_max_threads());
+        bench_config.size_count = parse_window_shapes(bench_sizes, &bench_config.sizes);
+        bench_config.k_count = parse_int_list(bench_ks, &bench_config.ks);
+        bench_config.thread_count = parse_int_list(bench_threads ? bench_threads : default_threads,
+                                                   &bench_config.threads);
+        bench_config.engine_count = parse_engine_list(bench_engines, &bench_config.engines);
+        int ok = bench_config.size_count > 0 && bench_config.k_count > 0 &&
+                 bench_config.thread_count > 0 && bench_config.engine_count > 0 &&
+                 bench_config.warmup >= 0 && bench_config.trials > 0;
+        if (ok)
+            run_benchmarks(&bench_config);
+        else if (rank == 0)
+            printf("Error: Invalid benchmark options\n");
+
+        free(bench_config.sizes);
+        free(bench_config.ks);
+        free(bench_config.threads);
+        free(bench_config.engines);
+        MPI_Finalize();
+        return ok ? 0 : 1;
+    }
+
+    if (bench_threads != NULL) {
+        int threads;
+        if (!parse_int_option(bench_threads, 1, INT_MAX, &threads)) {
+            if (rank == 0)
+                printf("Error: --threads must be a single positive integer outside --bench\n");
+            MPI_Finalize();
+            return 1;
+        }
+        omp_set_num_threads(threads);
+    }
+
+    // Check every engine and distribution against the reference scan
+    if (verify_cases > 0) {
+        int failures = run_verification(verify_cases, generator_seed);
+        MPI_Bcast(&failures, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Finalize();
+        return failures != 0;
+    }
+
+    // Placement is reported before the timed section
+    if (placement)
+        report_placement();
+
+    // Write the generated matrix to a binary file instead of searching
+    if (save_path != NULL) {
+        int ok = 1;
+        if (rank == 0) {
+            if (N == 0) {
+                printf("Enter matrix dimensions N and M: ");
+                scanf("%d %d", &N, &M);
+            }
+            ok = validate_parameters(N, M, 1);
+            if (ok) {
+                RowSource source = open_generator_source(N, M);
+                ok = write_matrix_file(save_path, &source);
+            }
+            if (ok)
+                printf("\nMatrix (%dx%d) written to %s\n", N, M, save_path);
+        }
+        MPI_Finalize();
+        return ok ? 0 : 1;
+    }
+
+    if (rank == 0) {
+        // Get input parameters
+        if (ctx.input_path != NULL) {
+            if (!read_matrix_header(ctx.input_path, &ctx.header)) {
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            N = (int)ctx.header.rows;
+            M = (int)ctx.header.cols;
+        } else if (N == 0) {
+            if (text_output) printf("Enter matrix dimensions N and M: ");
+            scanf("%d %d", &N, &M);
+        }
+
+        // Fixed-point sums are exact only while the whole matrix sums below
+        // 2^(53 - FIXED_POINT_BITS). Files may hold values outside
+        // MIN_VALUE..MAX_VALUE, so their largest value is looked up.
+        long long largest = GENERATED_MAX_MAGNITUDE;
+        if (fixed_point_scores && ctx.input_path != NULL)
+            largest = matrix_file_max_magnitude(ctx.input_path, &ctx.header);
+        if (fixed_point_scores && largest > 1 &&
+            (double)N * M * (log((double)largest) + ldexp(1.0, -FIXED_POINT_BITS)) >=
+                ldexp(1.0, 53 - FIXED_POINT_BITS)) {
+            printf("Error: %dx%d with values up to %lld is too large for --reproducible\n",
+                   N, M, largest);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        if (serve) {
+            // Every start position is owned by some rank and each block
+            // keeps the halo of the largest window that may be queried
+            if (!validate_parameters(N, M, 1)) {
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            // Every block keeps a halo of max_window - 1 rows and columns
+            int min_side = (N < M) ? N : M;
+            if (max_window == 0) max_window = DEFAULT_MAX_WINDOW;
+            if (max_window > min_side) max_window = min_side;
+            ctx.shape_rows = ctx.shape_cols = 1;
+            ctx.halo_rows = ctx.halo_cols = max_window - 1;
+            printf("\nParameters: N=%d, M=%d, server mode for windows up to %dx%d\n",
+                   N, M, max_window, max_window);
+        } else if (batch) {
+            // A batch searches from its smallest shape's start positions
+            // with the halo of its largest shape
+            ctx.shape_rows = ctx.shape_cols = INT_MAX;
+            ctx.halo_rows = ctx.halo_cols = 0;
+            if (!validate_parameters(N, M, 1)) {
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            // --area adds every shape of each area that fits
+            for (int r = 0; r < area_count; r++) {
+                add_area_shapes(areas[r], N, M, &shapes, &shape_count);
+                int fits = 0;
+                for (int q = 0; q < shape_count; q++)
+                    fits |= (long long)shapes[q].rows * shapes[q].cols == areas[r];
+                if (!fits) {
+                    printf("Error: No window of area %d fits in the %dx%d matrix\n", areas[r], N, M);
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+            }
+            for (int q = 0; q < shape_count; q++) {
+                if (shapes[q].rows > N || shapes[q].cols > M) {
+                    printf("Error: Window %dx%d does not fit in the %dx%d matrix\n",
+                           shapes[q].rows, shapes[q].cols, N, M);
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+                if (shapes[q].rows < ctx.shape_rows) ctx.shape_rows = shapes[q].rows;
+                if (shapes[q].cols < ctx.shape_cols) ctx.shape_cols = shapes[q].cols;
+                if (shapes[q].rows - 1 > ctx.halo_rows) ctx.halo_rows = shapes[q].rows - 1;
+                if (shapes[q].cols - 1 > ctx.halo_cols) ctx.halo_cols = shapes[q].cols - 1;
+            }
+            if (text_output)
+                printf("\nParameters: N=%d, M=%d, batch of %d window shapes\n", N, M, shape_count);
+        } else {
+            if (K == 0) {
+                if (text_output) printf("Enter submatrix size K: ");
+                scanf("%d", &K);
+            }
+
+            // Validate parameters
+            if (!validate_parameters(N, M, K)) {
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            ctx.shape_rows = ctx.shape_cols = K;
+            ctx.halo_rows = ctx.halo_cols = K - 1;
+            if (text_output)
+                printf("\nParameters: N=%d, M=%d, K=%d\n", N, M, K);
+        }
+        if (text_output) {
+            printf("Number of OpenMP threads: %d\n", omp_get_max_threads());
+            printf("SIMD kernels: %s\n", get_simd_kernels()->name);
+            if (fixed_point_scores)
+                printf("Scores: fixed point, multiples of 2^-%d\n", FIXED_POINT_BITS);
+            if (checkpoint.path != NULL)
+                printf("Checkpoints: %s.<rank>.{0,1} every %g seconds\n", checkpoint.path,
+                       checkpoint.interval);
+            if (engine == ENGINE_GPU)
+                printf("Offload devices: %d%s\n", omp_get_num_devices(),
+                       omp_get_num_devices() > 0 ? "" : " (target regions run on the host)");
+        }
+        ctx.N = N;
+        ctx.M = M;
+
+        if (ctx.input_path != NULL) {
+            // Each rank maps its own block; rank 0 maps the whole file only
+            // for printing and pages are read on demand. Checkpoints are
+            // taken between bands of STREAM_BAND_ROWS window rows.
+            ctx.band_rows = N - ctx.shape_rows + 1;
+            if (checkpoint.path != NULL && ctx.band_rows > STREAM_BAND_ROWS)
+                ctx.band_rows = STREAM_BAND_ROWS;
+            if (print_preview) {
+                ctx.matrix = map_matrix_file(ctx.input_path, &ctx.header, 0, 0, N, M, &input_mapping);
+                printf("Matrix mapped from %s\n", ctx.input_path);
+            }
+        } else {
+            // Matrices larger than MAX_MATRIX_SIZE are streamed in bands of
+            // STREAM_BAND_ROWS window rows; smaller ones are one single band
+            // unless pipelined, which needs bands to overlap, or checkpointed
+            int streaming = (N > MAX_MATRIX_SIZE || M > MAX_MATRIX_SIZE) ||
+                            ((ctx.pipeline || checkpoint.path != NULL) &&
+                             N - ctx.shape_rows + 1 > STREAM_BAND_ROWS);
+            ctx.band_rows = streaming ? STREAM_BAND_ROWS : N - ctx.shape_rows + 1;
+            int first_height = first_band_height(&ctx);
+
+            if (ctx.scatter) {
+                // Allocate and initialize the first band
+                ctx.source = open_generator_source(N, M);
+                ctx.matrix = allocate_matrix(first_height, M);
+                ctx.source.read_rows(&ctx.source, &ctx.matrix, 0, first_height);
+                if (streaming && text_output)
+                    printf("Streaming matrix in bands of %d rows\n", ctx.band_rows + ctx.halo_rows);
+            } else {
+                // Every rank generates its own block; rank 0 only keeps a
+                // copy of the matrix when asked to print it
+                if (!streaming && print_preview) {
+                    ctx.matrix = allocate_matrix(N, M);
+                    generate_random_matrix(&ctx.matrix);
+                } else if (streaming && text_output) {
+                    printf("Generating blocks on every rank in bands of %d rows\n",
+                           ctx.band_rows + ctx.halo_rows);
+                }
+            }
+        }
+
+        if (print_preview && ctx.band_rows == N - ctx.shape_rows + 1) {
+            if (N <= 10 && M <= 10)
+                print_matrix(&ctx.matrix, 10);
+            else
+                print_matrix(&ctx.matrix, 5);
+        }
+
+        start_time = omp_get_wtime();
+    }
+
+    // Share matrix dimensions, K, the window extents and the band height
+    int params[8] = {N, M, K, ctx.band_rows,
+                     ctx.shape_rows, ctx.shape_cols, ctx.halo_rows, ctx.halo_cols};
+    MPI_Bcast(params, 8, MPI_INT, 0, MPI_COMM_WORLD);
+    N = ctx.N = params[0];
+    M = ctx.M = params[1];
+    K = params[2];
+    ctx.band_rows = params[3];
+    ctx.shape_rows = params[4];
+    ctx.shape_cols = params[5];
+    ctx.halo_rows = params[6];
+    ctx.halo_cols = params[7];
+
+    // Shapes of an area depend on the matrix, so rank 0 shares the list
+    if (batch) {
+        MPI_Bcast(&shape_count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (rank != 0) {
+            shapes = (WindowShape *)realloc(shapes, shape_count * sizeof(WindowShape));
+            if (shapes == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+        }
+        MPI_Bcast(shapes, 2 * shape_count, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+    if (ctx.input_path != NULL && rank != 0 && !read_matrix_header(ctx.input_path, &ctx.header)) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // Split the window start positions (of each band when rank 0
+    // distributes the matrix) over a 2D process grid
+    int grid_rows = (ctx.input_path == NULL && ctx.scatter) ? first_band_height(&ctx) : N;
+    create_process_grid(size, grid_rows, M, ctx.dims);
+    if (rank == 0 && text_output)
+        printf("Number of MPI processes: %d (grid %dx%d)\n", size, ctx.dims[0], ctx.dims[1]);
+
+    if (serve) {
+        // Distribute once and keep every block's prefix tables resident.
+        // Without scattering, a rank's bands are all of one block.
+        ResidentSet resident = {NULL, 0, 0, 0};
+        if (!ctx.scatter) {
+            RankBlock block = get_rank_block(rank, ctx.dims, N - ctx.shape_rows + 1,
+                                             M - ctx.shape_cols + 1);
+            int local_cols;
+            get_block_extent(&block, N, M, ctx.halo_rows, ctx.halo_cols, &resident.reserve_rows,
+                             &local_cols);
+        }
+        search_pass(&ctx, keep_resident_block, &resident);
+        build_resident_tables(&resident);
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (rank == 0) {
+            printf("Resident tables built in %.6f seconds\n", omp_get_wtime() - start_time);
+            printf("Enter queries as K or PxQ, optionally followed by R, updates as\n"
+                   "'set i j v [i j v ...]'; quit to exit\n");
+        }
+        serve_queries(&ctx, &resident);
+        free_resident_set(&resident);
+    } else if (batch) {
+        // One pass distributes the data and builds each block's prefix
+        // tables once for the whole batch; one reduction combines every
+        // shape's results
+        SubmatrixResult *lists = (SubmatrixResult *)malloc((size_t)shape_count * top_count * sizeof(SubmatrixResult));
+        if (lists == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        search_batch_windows(&ctx, shapes, shape_count, top_count, lists);
+
+        if (rank == 0 && !text_output) {
+            end_time = omp_get_wtime();
+            printf("{\"mode\": \"batch\", \"engine\": \"%s\", \"N\": %d, \"M\": %d, "
+                   "\"ranks\": %d, \"threads\": %d, \"time_s\": %.6f, \"windows\": [",
+                   engine_name(engine), N, M, size, omp_get_max_threads(), end_time - start_time);
+            for (int q = 0; q < shape_count; q++) {
+                printf("%s{\"rows\": %d, \"cols\": %d, \"results\": ", q > 0 ? ", " : "",
+                       shapes[q].rows, shapes[q].cols);
+                print_results_json(lists + (size_t)q * top_count, top_count);
+                printf("}");
+            }
+            printf("]");
+            if (area_count > 0) {
+                printf(", \"areas\": [");
+                for (int r = 0; r < area_count; r++) {
+                    int q = best_shape_of_area(shapes, shape_count, lists, top_count, areas[r]);
+                    printf("%s{\"area\": %d, ", r > 0 ? ", " : "", areas[r]);
+                    if (q < 0)
+                        printf("\"best\": null}");
+                    else
+                        printf("\"rows\": %d, \"cols\": %d, \"row\": %d, \"col\": %d, "
+                               "\"log_sum\": %.6f}", shapes[q].rows, shapes[q].cols,
+                               lists[(size_t)q * top_count].row, lists[(size_t)q * top_count].col,
+                               lists[(size_t)q * top_count].max_log_product);
+                }
+                printf("]");
+            }
+            printf("}\n");
+        } else if (rank == 0) {
+            end_time = omp_get_wtime();
+            for (int q = 0; q < shape_count; q++) {
+                const SubmatrixResult *list = lists + (size_t)q * top_count;
+                if (list[0].row == -1) {
+                    printf("Window %dx%d: no valid submatrix found with odd elements\n",
+                           shapes[q].rows, shapes[q].cols);
+                    continue;
+                }
+                printf("Window %dx%d: best at (%d, %d), log sum %.6f\n", shapes[q].rows,
+                       shapes[q].cols, list[0].row, list[0].col, list[0].max_log_product);
+                for (int k = 0; top_count > 1 && k < top_count && list[k].row != -1; k++)
+                    printf("%4d. (%d, %d) log sum %.6f\n", k + 1, list[k].row,
+                           list[k].col, list[k].max_log_product);
+            }
+            for (int r = 0; r < area_count; r++) {
+                int q = best_shape_of_area(shapes, shape_count, lists, top_count, areas[r]);
+                if (q >= 0)
+                    printf("Best window of area %d: %dx%d at (%d, %d), log sum %.6f\n", areas[r],
+                           shapes[q].rows, shapes[q].cols, lists[(size_t)q * top_count].row,
+                           lists[(size_t)q * top_count].col,
+                           lists[(size_t)q * top_count].max_log_product);
+                else
+                    printf("Area %d: no valid submatrix found with odd elements\n", areas[r]);
+            }
+            printf("Execution time: %.6f seconds\n", end_time - start_time);
+        }
+
+        free(lists);
+    } else {
+        SubmatrixResult *selected = (SubmatrixResult *)malloc(top_count * sizeof(SubmatrixResult));
+        if (selected == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        int selected_count = search_top_windows(&ctx, engine, K, top_count, distinct, selected,
+                                                checkpoint.path != NULL ? &checkpoint : NULL);
+        int resumed_ranks = 0;
+        MPI_Reduce(&checkpoint.resumed, &resumed_ranks, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && text_output && resumed_ranks > 0)
+            printf("Resumed %d of %d ranks from checkpoints\n", resumed_ranks, size);
+
+        if (rank == 0 && !text_output) {
+            end_time = omp_get_wtime();
+            printf("{\"mode\": \"single\", \"engine\": \"%s\", \"N\": %d, \"M\": %d, \"K\": %d, "
+                   "\"ranks\": %d, \"threads\": %d, \"distinct\": %s, \"time_s\": %.6f, "
+                   "\"results\": ", engine_name(engine), N, M, K, size, omp_get_max_threads(),
+                   distinct ? "true" : "false", end_time - start_time);
+            print_results_json(selected, selected_count);
+            printf("}\n");
+        } else if (rank == 0) {
+            end_time = omp_get_wtime();
+
+            if (selected_count > 0) {
+                SubmatrixResult result = selected[0];
+                printf("Best submatrix found at position: (%d, %d)\n", result.row, result.col);
+                printf("Log sum of odd elements: %.6f\n", result.max_log_product);
+
+                if (top_count > 1) {
+                    printf("Top %d submatrices%s:\n", top_count, distinct ? " (non-overlapping)" : "");
+                    for (int k = 0; k < selected_count; k++)
+                        printf("%4d. (%d, %d) log sum %.6f\n", k + 1, selected[k].row,
+                               selected[k].col, selected[k].max_log_product);
+                }
+
+                if (print_preview && N <= 20 && M <= 20)
+                    print_submatrix(&ctx.matrix, result.row, result.col, K);
+
+                printf("Execution time: %.6f seconds\n", end_time - start_time);
+            } else {
+                printf("No valid submatrix found with odd elements\n");
+            }
+        }
+        free(selected);
+    }
+
+    if (report_path != NULL) {
+        const char *mode = serve ? "serve" : (batch ? "batch" : "single");
+        if (write_report(report_path, &ctx, mode, engine_name(engine), K) && rank == 0 &&
+            text_output)
+            printf("Report written to %s\n", report_path);
+    }
+
+    if (rank == 0) {
+        if (ctx.input_path != NULL)
+            unmap_matrix_file(&input_mapping);
+        else
+            free_matrix(&ctx.matrix);
     }
+    free(shapes);
+    free(areas);
 
     //Finalize MPI
     MPI_Finalize();